@@ -3,6 +3,7 @@
 
 #define _USE_MATH_DEFINES
 #include <shader.h>
+#include <random.h>
 #include <cmath>
 #include <iostream>
 #include <vector>
@@ -35,6 +36,8 @@ const unsigned int SCR_HEIGHT = 600;
 std::vector<SceneObject> sceneObjects;
 std::vector<Shader> shaderPrograms;
 Shader* activeShader;
+// colors of the cones
+Random randomStream(1);
 
 
 int main()
@@ -202,7 +205,7 @@ void button_input_callback(GLFWwindow* window, int button, int action, int mods)
         glfwGetWindowSize(window, &width, &height);
         offsetX = mouseXPos / width * 2 -1.f;
         offsetY = (mouseYPos / height * 2 -1.f) * -1;
-        SceneObject cone = instantiateCone((float) rand()/RAND_MAX, (float) rand()/RAND_MAX, (float) rand()/RAND_MAX, offsetX, offsetY);
+        SceneObject cone = instantiateCone(randomStream.nextFloat(), randomStream.nextFloat(), randomStream.nextFloat(), offsetX, offsetY);
         sceneObjects.push_back(cone);
     }
 }
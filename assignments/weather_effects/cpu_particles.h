@@ -0,0 +1,414 @@
+//
+// CPU particle simulation: structure of arrays advanced eight particles at a time with AVX2, on all the cores.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_CPU_PARTICLES_H
+#define ITU_GRAPHICS_PROGRAMMING_CPU_PARTICLES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gl_state.h>
+#include <job_system.h>
+#include <profiler.h>
+#include <render_queue.h>
+#include <stream_buffer.h>
+
+#include "particle_simulation.h"
+
+// The AVX2 kernels are compiled for AVX2 whatever the target of the rest of the program (GCC and Clang function
+// attribute, MSVC always accepts the intrinsics), and only called if the CPU supports AVX2 and FMA.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#define ITU_CPU_PARTICLES_AVX2
+#if defined(__GNUC__)
+#define ITU_AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#else
+#include <intrin.h>
+#define ITU_AVX2_FUNCTION
+#endif
+#endif
+
+// Same simulation as shaders/particleUpdate.vert, but for the turbulence: the particles fall at the speed they
+// spawned with, their horizontal velocity follows the wind, they wrap around the box and respawn at the end of
+// their lifetime. Each attribute is an array of its own, 64 byte aligned and padded to a multiple of 8 particles,
+// so that the update reads and writes whole cache lines and whole AVX2 registers.
+// The arrays are split in ranges of GRAIN particles that run as jobs of the JobSystem.
+// No GL context is needed, the vertices are written by writeVertices(), see CpuParticleStream.
+class CpuParticles
+{
+public:
+    static const unsigned int LANES = 8;
+    static const unsigned int GRAIN = 16384; // particles per job
+
+    // the attribute arrays, in the order of SimulatedParticle
+    enum Attribute {X, Y, Z, AGE, VX, VY, VZ, LIFETIME, ATTRIBUTE_COUNT};
+
+    explicit CpuParticles(unsigned int count) : count(count)
+    {
+        paddedCount = (count + LANES - 1) / LANES * LANES;
+        stride = (paddedCount + 15) / 16 * 16; // 16 floats, 64 bytes
+        storage.resize(stride * ATTRIBUTE_COUNT + 16);
+        float* base = storage.data();
+        while (reinterpret_cast<std::uintptr_t>(base) % 64 != 0)
+            base++;
+        for (unsigned int a = 0; a < ATTRIBUTE_COUNT; a++)
+            arrays[a] = base + (size_t) a * stride;
+        // an age past the lifetime, the first update spawns every particle
+        std::fill(arrays[AGE], arrays[AGE] + paddedCount, 1.0f);
+        std::fill(arrays[LIFETIME], arrays[LIFETIME] + paddedCount, 0.0f);
+        useAvx2 = hasAvx2();
+    }
+
+    unsigned int getCount() const { return count; }
+    bool isUsingAvx2() const { return useAvx2; }
+    // for comparing the kernels
+    void setUseAvx2(bool use) { useAvx2 = use && hasAvx2(); }
+    const float* getArray(Attribute attribute) const { return arrays[attribute]; }
+
+    // advances the particles by 'deltaTime' seconds
+    void update(const ParticleSimulationSettings &settings, float deltaTime)
+    {
+        PROFILE_SCOPE("CpuParticles::update");
+        Step step = makeStep(settings, deltaTime, ++updates);
+        JobSystem::instance().parallelFor(0, paddedCount, GRAIN, [this, &step](unsigned int begin, unsigned int end) {
+#ifdef ITU_CPU_PARTICLES_AVX2
+            if (useAvx2)
+            {
+                updateAvx2(step, begin, end);
+                return;
+            }
+#endif
+            updateScalar(step, begin, end);
+        });
+    }
+
+    // writes the particles as SimulatedParticle vertices to 'vertices' (getCount() of them)
+    void writeVertices(SimulatedParticle* vertices) const
+    {
+        PROFILE_SCOPE("CpuParticles::writeVertices");
+        JobSystem::instance().parallelFor(0, paddedCount, GRAIN, [this, vertices](unsigned int begin, unsigned int end) {
+            // the padding particles past 'count' are not written
+            unsigned int last = std::min(end, count), i = begin;
+            if (begin >= last)
+                return;
+#ifdef ITU_CPU_PARTICLES_AVX2
+            if (useAvx2)
+                i = writeVerticesAvx2(vertices, begin, begin + (last - begin) / LANES * LANES);
+#endif
+            for (; i < last; i++)
+                vertices[i] = {glm::vec3(arrays[X][i], arrays[Y][i], arrays[Z][i]), arrays[AGE][i],
+                               glm::vec3(arrays[VX][i], arrays[VY][i], arrays[VZ][i]), arrays[LIFETIME][i]};
+        });
+    }
+
+    CpuParticles(const CpuParticles&) = delete;
+    CpuParticles& operator=(const CpuParticles&) = delete;
+
+private:
+    unsigned int count, paddedCount, stride;
+    std::vector<float> storage;
+    float* arrays[ATTRIBUTE_COUNT];
+    std::uint32_t updates = 0;
+    bool useAvx2 = false;
+
+    // the settings of an update, in the form the kernels use
+    struct Step {
+        float deltaTime, windBlend;
+        float windX, windZ;
+        float boxMin[3], boxSize, inverseBoxSize;
+        float minFallSpeed, fallSpeedRange, minLifetime, lifetimeRange;
+        std::uint32_t seed;
+    };
+
+    static Step makeStep(const ParticleSimulationSettings &settings, float deltaTime, std::uint32_t update)
+    {
+        Step step;
+        step.deltaTime = deltaTime;
+        step.windBlend = std::min(1.0f, deltaTime * 2.0f);
+        step.windX = settings.wind.x;
+        step.windZ = settings.wind.z;
+        for (int i = 0; i < 3; i++)
+            step.boxMin[i] = settings.boxCenter[i] - settings.boxSize * 0.5f;
+        step.boxSize = settings.boxSize;
+        step.inverseBoxSize = 1.0f / settings.boxSize;
+        step.minFallSpeed = settings.minFallSpeed;
+        step.fallSpeedRange = settings.maxFallSpeed - settings.minFallSpeed;
+        step.minLifetime = settings.minLifetime;
+        step.lifetimeRange = settings.maxLifetime - settings.minLifetime;
+        step.seed = pcgHash(update);
+        return step;
+    }
+
+    // PCG hash, as in the shader; a random sequence per particle and update
+    static std::uint32_t pcgHash(std::uint32_t value)
+    {
+        std::uint32_t state = value * 747796405u + 2891336453u;
+        std::uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    // 24 random bits to [0, 1)
+    static float unitFloat(std::uint32_t bits) { return (float) (bits >> 8) * (1.0f / 16777216.0f); }
+
+    void updateScalar(const Step &step, unsigned int begin, unsigned int end)
+    {
+        float* x = arrays[X], * y = arrays[Y], * z = arrays[Z], * age = arrays[AGE];
+        float* vx = arrays[VX], * vy = arrays[VY], * vz = arrays[VZ], * lifetime = arrays[LIFETIME];
+        for (unsigned int i = begin; i < end; i++)
+        {
+            age[i] += step.deltaTime;
+            if (age[i] >= lifetime[i])
+            {
+                std::uint32_t r0 = pcgHash(i ^ step.seed), r1 = pcgHash(r0), r2 = pcgHash(r1), r3 = pcgHash(r2), r4 = pcgHash(r3);
+                x[i] = step.boxMin[0] + unitFloat(r0) * step.boxSize;
+                y[i] = step.boxMin[1] + unitFloat(r1) * step.boxSize;
+                z[i] = step.boxMin[2] + unitFloat(r2) * step.boxSize;
+                vx[i] = step.windX;
+                vy[i] = -(step.minFallSpeed + unitFloat(r3) * step.fallSpeedRange);
+                vz[i] = step.windZ;
+                lifetime[i] = step.minLifetime + unitFloat(r4) * step.lifetimeRange;
+                age[i] = 0.0f;
+                continue;
+            }
+            vx[i] += (step.windX - vx[i]) * step.windBlend;
+            vz[i] += (step.windZ - vz[i]) * step.windBlend;
+            x[i] = wrap(x[i] + vx[i] * step.deltaTime, step.boxMin[0], step);
+            y[i] = wrap(y[i] + vy[i] * step.deltaTime, step.boxMin[1], step);
+            z[i] = wrap(z[i] + vz[i] * step.deltaTime, step.boxMin[2], step);
+        }
+    }
+
+    static float wrap(float value, float boxMin, const Step &step)
+    {
+        float offset = value - boxMin;
+        return boxMin + offset - step.boxSize * std::floor(offset * step.inverseBoxSize);
+    }
+
+#ifdef ITU_CPU_PARTICLES_AVX2
+    static bool hasAvx2()
+    {
+#if defined(__GNUC__)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0, osxsave = (info[2] & (1 << 27)) != 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        // the OS saves the YMM registers
+        return fma && avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#endif
+    }
+
+    ITU_AVX2_FUNCTION static __m256i pcgHash8(__m256i value)
+    {
+        __m256i state = _mm256_add_epi32(_mm256_mullo_epi32(value, _mm256_set1_epi32((int) 747796405u)),
+                                         _mm256_set1_epi32((int) 2891336453u));
+        __m256i shift = _mm256_add_epi32(_mm256_srli_epi32(state, 28), _mm256_set1_epi32(4));
+        __m256i word = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_srlv_epi32(state, shift), state),
+                                          _mm256_set1_epi32(277803737));
+        return _mm256_xor_si256(_mm256_srli_epi32(word, 22), word);
+    }
+
+    ITU_AVX2_FUNCTION static __m256 unitFloat8(__m256i bits)
+    {
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+    }
+
+    ITU_AVX2_FUNCTION static __m256 wrap8(__m256 value, __m256 boxMin, __m256 boxSize, __m256 inverseBoxSize)
+    {
+        __m256 offset = _mm256_sub_ps(value, boxMin);
+        __m256 turns = _mm256_floor_ps(_mm256_mul_ps(offset, inverseBoxSize));
+        return _mm256_add_ps(boxMin, _mm256_fnmadd_ps(boxSize, turns, offset));
+    }
+
+    ITU_AVX2_FUNCTION void updateAvx2(const Step &step, unsigned int begin, unsigned int end)
+    {
+        float* x = arrays[X], * y = arrays[Y], * z = arrays[Z], * age = arrays[AGE];
+        float* vx = arrays[VX], * vy = arrays[VY], * vz = arrays[VZ], * lifetime = arrays[LIFETIME];
+        const __m256 deltaTime = _mm256_set1_ps(step.deltaTime), windBlend = _mm256_set1_ps(step.windBlend);
+        const __m256 windX = _mm256_set1_ps(step.windX), windZ = _mm256_set1_ps(step.windZ);
+        const __m256 boxMinX = _mm256_set1_ps(step.boxMin[0]), boxMinY = _mm256_set1_ps(step.boxMin[1]),
+                     boxMinZ = _mm256_set1_ps(step.boxMin[2]);
+        const __m256 boxSize = _mm256_set1_ps(step.boxSize), inverseBoxSize = _mm256_set1_ps(step.inverseBoxSize);
+        const __m256i seed = _mm256_set1_epi32((int) step.seed), laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        for (unsigned int i = begin; i < end; i += LANES)
+        {
+            __m256 particleAge = _mm256_add_ps(_mm256_load_ps(age + i), deltaTime);
+            __m256 particleLifetime = _mm256_load_ps(lifetime + i);
+            __m256 velocityX = _mm256_load_ps(vx + i), velocityY = _mm256_load_ps(vy + i), velocityZ = _mm256_load_ps(vz + i);
+
+            velocityX = _mm256_fmadd_ps(_mm256_sub_ps(windX, velocityX), windBlend, velocityX);
+            velocityZ = _mm256_fmadd_ps(_mm256_sub_ps(windZ, velocityZ), windBlend, velocityZ);
+            __m256 positionX = wrap8(_mm256_fmadd_ps(velocityX, deltaTime, _mm256_load_ps(x + i)), boxMinX, boxSize, inverseBoxSize);
+            __m256 positionY = wrap8(_mm256_fmadd_ps(velocityY, deltaTime, _mm256_load_ps(y + i)), boxMinY, boxSize, inverseBoxSize);
+            __m256 positionZ = wrap8(_mm256_fmadd_ps(velocityZ, deltaTime, _mm256_load_ps(z + i)), boxMinZ, boxSize, inverseBoxSize);
+
+            // respawn the lanes past their lifetime, rare enough to test for
+            __m256 respawn = _mm256_cmp_ps(particleAge, particleLifetime, _CMP_GE_OQ);
+            if (_mm256_movemask_ps(respawn))
+            {
+                __m256i index = _mm256_add_epi32(_mm256_set1_epi32((int) i), laneIndex);
+                __m256i r0 = pcgHash8(_mm256_xor_si256(index, seed)), r1 = pcgHash8(r0), r2 = pcgHash8(r1),
+                        r3 = pcgHash8(r2), r4 = pcgHash8(r3);
+                positionX = _mm256_blendv_ps(positionX, _mm256_fmadd_ps(unitFloat8(r0), boxSize, boxMinX), respawn);
+                positionY = _mm256_blendv_ps(positionY, _mm256_fmadd_ps(unitFloat8(r1), boxSize, boxMinY), respawn);
+                positionZ = _mm256_blendv_ps(positionZ, _mm256_fmadd_ps(unitFloat8(r2), boxSize, boxMinZ), respawn);
+                velocityX = _mm256_blendv_ps(velocityX, windX, respawn);
+                __m256 fallSpeed = _mm256_fmadd_ps(unitFloat8(r3), _mm256_set1_ps(step.fallSpeedRange), _mm256_set1_ps(step.minFallSpeed));
+                velocityY = _mm256_blendv_ps(velocityY, _mm256_sub_ps(_mm256_setzero_ps(), fallSpeed), respawn);
+                velocityZ = _mm256_blendv_ps(velocityZ, windZ, respawn);
+                __m256 newLifetime = _mm256_fmadd_ps(unitFloat8(r4), _mm256_set1_ps(step.lifetimeRange), _mm256_set1_ps(step.minLifetime));
+                particleLifetime = _mm256_blendv_ps(particleLifetime, newLifetime, respawn);
+                particleAge = _mm256_blendv_ps(particleAge, _mm256_setzero_ps(), respawn);
+                _mm256_store_ps(lifetime + i, particleLifetime);
+                _mm256_store_ps(vy + i, velocityY);
+            }
+
+            _mm256_store_ps(x + i, positionX);
+            _mm256_store_ps(y + i, positionY);
+            _mm256_store_ps(z + i, positionZ);
+            _mm256_store_ps(age + i, particleAge);
+            _mm256_store_ps(vx + i, velocityX);
+            _mm256_store_ps(vz + i, velocityZ);
+        }
+    }
+
+    // eight particles at a time: the eight attribute registers of eight particles are transposed into the eight
+    // SimulatedParticle of these particles; returns where it stopped ('end', a multiple of 8)
+    ITU_AVX2_FUNCTION unsigned int writeVerticesAvx2(SimulatedParticle* vertices, unsigned int begin, unsigned int end) const
+    {
+        for (unsigned int i = begin; i < end; i += LANES)
+        {
+            __m256 r[ATTRIBUTE_COUNT];
+            for (unsigned int a = 0; a < ATTRIBUTE_COUNT; a++)
+                r[a] = _mm256_load_ps(arrays[a] + i);
+            __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+            __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+            __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+            __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+            __m256 s0 = _mm256_shuffle_ps(t0, t2, 0x44), s1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+            __m256 s2 = _mm256_shuffle_ps(t1, t3, 0x44), s3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+            __m256 s4 = _mm256_shuffle_ps(t4, t6, 0x44), s5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+            __m256 s6 = _mm256_shuffle_ps(t5, t7, 0x44), s7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+            float* out = reinterpret_cast<float*>(vertices + i);
+            _mm256_storeu_ps(out + 0, _mm256_permute2f128_ps(s0, s4, 0x20));
+            _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(s1, s5, 0x20));
+            _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(s2, s6, 0x20));
+            _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(s3, s7, 0x20));
+            _mm256_storeu_ps(out + 32, _mm256_permute2f128_ps(s0, s4, 0x31));
+            _mm256_storeu_ps(out + 40, _mm256_permute2f128_ps(s1, s5, 0x31));
+            _mm256_storeu_ps(out + 48, _mm256_permute2f128_ps(s2, s6, 0x31));
+            _mm256_storeu_ps(out + 56, _mm256_permute2f128_ps(s3, s7, 0x31));
+        }
+        return end;
+    }
+#else
+    static bool hasAvx2() { return false; }
+#endif
+};
+
+// Streams the vertices of a CpuParticles to the GPU once per frame, through a persistent mapped StreamBuffer
+// (see StreamBuffer for the fallback of older contexts): the vertices are written by the jobs straight into the
+// region of the frame, and the vertex arrays are pointed at it. The region has room for as many indices, for the
+// order of the points of a depth sort (see uploadIndices()).
+class CpuParticleStream
+{
+public:
+    explicit CpuParticleStream(unsigned int count)
+            : count(count), stream(new StreamBuffer((GLsizeiptr) count * (sizeof(SimulatedParticle) + sizeof(std::uint32_t)) + 64))
+    {
+        glGenVertexArrays(1, &pointArray);
+        glGenVertexArrays(1, &lineArray);
+    }
+
+    ~CpuParticleStream()
+    {
+        glDeleteVertexArrays(1, &pointArray);
+        glDeleteVertexArrays(1, &lineArray);
+        delete stream;
+        GLState::invalidate();
+    }
+
+    // copies the current state of 'particles' (of 'count' particles) to the GPU, call it once per frame
+    void upload(const CpuParticles &particles)
+    {
+        stream->beginFrame();
+        StreamBuffer::Allocation allocation = stream->allocate((GLsizeiptr) count * sizeof(SimulatedParticle), 64);
+        if (!allocation.pointer)
+            return;
+        particles.writeVertices(static_cast<SimulatedParticle*>(allocation.pointer));
+        stream->commit(allocation);
+
+        GLState::bindVertexArray(pointArray);
+        setupSimulatedParticleAttributes(stream->ID, 0, allocation.offset);
+        GLState::bindVertexArray(lineArray);
+        setupSimulatedParticleAttributes(stream->ID, 1, allocation.offset);
+        GLState::bindVertexArray(0);
+        uploaded = true;
+        sorted = false;
+    }
+
+    // draws the points in the order of 'indices' ('indexCount' of them, e.g. the visible particles back to front),
+    // until the next upload(); call it after upload()
+    void uploadIndices(const std::uint32_t* indices, unsigned int indexCount)
+    {
+        GLintptr offset = stream->upload(indices, (GLsizeiptr) indexCount * sizeof(std::uint32_t), 64);
+        if (offset < 0)
+            return;
+        // the element buffer is part of the vertex array
+        GLState::bindVertexArray(pointArray);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream->ID);
+        GLState::bindVertexArray(0);
+        sortedFirst = (GLint) (offset / sizeof(std::uint32_t));
+        sortedCount = indexCount;
+        sorted = true;
+    }
+
+    // draw of the particles as GL_POINTS, or as instanced GL_LINES (see GpuParticles::makeDraw); the points are
+    // drawn in the order of the indices of the frame, if any
+    RenderQueue::Draw makeDraw(unsigned int drawProgram, GLenum mode) const
+    {
+        RenderQueue::Draw draw;
+        draw.program = drawProgram;
+        draw.mode = mode;
+        draw.indexed = false;
+        draw.VAO = mode == GL_LINES ? lineArray : pointArray;
+        // nothing to draw before the first upload
+        draw.count = !uploaded ? 0 : (mode == GL_LINES ? 2 : count);
+        draw.instanceCount = uploaded && mode == GL_LINES ? count : 0;
+        if (sorted && mode != GL_LINES)
+        {
+            draw.indexed = true;
+            draw.first = sortedFirst;
+            draw.count = sortedCount;
+        }
+        return draw;
+    }
+
+    CpuParticleStream(const CpuParticleStream&) = delete;
+    CpuParticleStream& operator=(const CpuParticleStream&) = delete;
+
+private:
+    unsigned int count;
+    StreamBuffer* stream;
+    GLuint pointArray = 0, lineArray = 0;
+    bool uploaded = false;
+    // indices of the points of this frame, in elements from the start of the buffer
+    bool sorted = false;
+    GLint sortedFirst = 0;
+    GLsizei sortedCount = 0;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_CPU_PARTICLES_H
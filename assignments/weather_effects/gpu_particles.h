@@ -0,0 +1,195 @@
+//
+// GPU particle simulation: the particles are advanced by a vertex shader and written back with transform feedback.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_GPU_PARTICLES_H
+#define ITU_GRAPHICS_PROGRAMMING_GPU_PARTICLES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gl_state.h>
+#include <program_cache.h>
+#include <render_queue.h>
+
+#include "particle_simulation.h"
+
+// The particles live in two vertex buffers: update() draws the particles of one of them as points, with the
+// rasterizer off, and shaders/particleUpdate.vert writes the advanced particles to the other one through transform
+// feedback; then the two buffers swap roles. The CPU only sets a few uniforms per update, whatever the number of
+// particles. The particles start with an age past their lifetime, so the first update spawns all of them.
+class GpuParticles
+{
+public:
+    explicit GpuParticles(unsigned int count) : count(count)
+    {
+        createProgram("shaders/particleUpdate.vert");
+
+        std::vector<SimulatedParticle> particles(count, SimulatedParticle{glm::vec3(0.0f), 1.0f, glm::vec3(0.0f), 0.0f});
+        glGenBuffers(2, buffers);
+        glGenVertexArrays(2, vertexArrays);
+        glGenVertexArrays(2, lineArrays);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(SimulatedParticle), particles.data(), GL_DYNAMIC_COPY);
+            // one vertex per particle, for the update and the points
+            GLState::bindVertexArray(vertexArrays[i]);
+            setupSimulatedParticleAttributes(buffers[i], 0);
+            // one instance per particle, for the lines
+            GLState::bindVertexArray(lineArrays[i]);
+            setupSimulatedParticleAttributes(buffers[i], 1);
+        }
+        GLState::bindVertexArray(0);
+    }
+
+    ~GpuParticles()
+    {
+        glDeleteVertexArrays(2, vertexArrays);
+        glDeleteVertexArrays(2, lineArrays);
+        glDeleteBuffers(2, buffers);
+        glDeleteProgram(program);
+        GLState::invalidate();
+    }
+
+    // advances the particles by 'deltaTime' seconds; 'time' drives the turbulence
+    void update(const ParticleSimulationSettings &settings, float deltaTime, float time)
+    {
+        GLState::useProgram(program);
+        glUniform1f(deltaTimeLocation, deltaTime);
+        glUniform1f(timeLocation, time);
+        glUniform1ui(seedLocation, ++updates);
+        glUniform3fv(boxCenterLocation, 1, &settings.boxCenter[0]);
+        glUniform1f(boxSizeLocation, settings.boxSize);
+        glUniform3fv(windLocation, 1, &settings.wind[0]);
+        glUniform1f(turbulenceLocation, settings.turbulence);
+        glUniform2f(fallSpeedLocation, settings.minFallSpeed, settings.maxFallSpeed);
+        glUniform2f(lifetimeLocation, settings.minLifetime, settings.maxLifetime);
+
+        GLState::bindVertexArray(vertexArrays[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        current = 1 - current;
+    }
+
+    // draw of the particles as GL_POINTS (one vertex per particle) or GL_LINES (one instance of two vertices per
+    // particle, the vertex shader picks the end of the segment with gl_VertexID); with an 'indexBuffer' of count
+    // indices (e.g. GpuParticleSort::getIndexBuffer()), the points are drawn in its order
+    RenderQueue::Draw makeDraw(unsigned int drawProgram, GLenum mode, GLuint indexBuffer = 0) const
+    {
+        RenderQueue::Draw draw;
+        draw.program = drawProgram;
+        draw.mode = mode;
+        draw.indexed = false;
+        if (mode == GL_LINES)
+        {
+            draw.VAO = lineArrays[current];
+            draw.count = 2;
+            draw.instanceCount = count;
+        }
+        else
+        {
+            draw.VAO = vertexArrays[current];
+            draw.count = count;
+            if (indexBuffer)
+            {
+                // the element buffer is part of the vertex array, the updates draw arrays and ignore it
+                GLState::bindVertexArray(vertexArrays[current]);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+                GLState::bindVertexArray(0);
+                draw.indexed = true;
+            }
+        }
+        return draw;
+    }
+
+    unsigned int getCount() const { return count; }
+    // vertex buffer of the current particles, as SimulatedParticle
+    GLuint getBuffer() const { return buffers[current]; }
+
+    GpuParticles(const GpuParticles&) = delete;
+    GpuParticles& operator=(const GpuParticles&) = delete;
+
+private:
+    unsigned int count;
+    GLuint program = 0;
+    GLuint buffers[2] = {0, 0};
+    GLuint vertexArrays[2] = {0, 0};
+    GLuint lineArrays[2] = {0, 0};
+    // buffer that holds the current particles
+    unsigned int current = 0;
+    unsigned int updates = 0;
+
+    GLint deltaTimeLocation = -1, timeLocation = -1, seedLocation = -1, boxCenterLocation = -1, boxSizeLocation = -1,
+          windLocation = -1, turbulenceLocation = -1, fallSpeedLocation = -1, lifetimeLocation = -1;
+
+    void createProgram(const char* vertexPath)
+    {
+        std::string vertexCode;
+        std::ifstream vShaderFile(vertexPath);
+        if (vShaderFile)
+        {
+            std::stringstream vShaderStream;
+            vShaderStream << vShaderFile.rdbuf();
+            vertexCode = vShaderStream.str();
+        }
+        else
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << vertexPath << std::endl;
+
+        // the captured outputs are part of the link, and so of the cached binary
+        const char* varyings[] = {"outPosition", "outVelocity"};
+        program = glCreateProgram();
+        std::string cacheKey = ProgramCache::makeKey({vertexCode}, "transform feedback: outPosition, outVelocity");
+        if (!ProgramCache::load(program, cacheKey))
+        {
+            const char* vShaderCode = vertexCode.c_str();
+            GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+            glShaderSource(vertex, 1, &vShaderCode, NULL);
+            glCompileShader(vertex);
+            GLint success;
+            char infoLog[1024];
+            glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(vertex, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: VERTEX\n" << infoLog << std::endl;
+            }
+            glAttachShader(program, vertex);
+            glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+            ProgramCache::prepare(program);
+            glLinkProgram(program);
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(program, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << std::endl;
+            }
+            else
+                ProgramCache::store(program, cacheKey);
+            glDeleteShader(vertex);
+        }
+
+        deltaTimeLocation = glGetUniformLocation(program, "deltaTime");
+        timeLocation = glGetUniformLocation(program, "time");
+        seedLocation = glGetUniformLocation(program, "seed");
+        boxCenterLocation = glGetUniformLocation(program, "boxCenter");
+        boxSizeLocation = glGetUniformLocation(program, "boxSize");
+        windLocation = glGetUniformLocation(program, "wind");
+        turbulenceLocation = glGetUniformLocation(program, "turbulence");
+        fallSpeedLocation = glGetUniformLocation(program, "fallSpeed");
+        lifetimeLocation = glGetUniformLocation(program, "lifetime");
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_GPU_PARTICLES_H
@@ -4,25 +4,58 @@
 
 #include <iostream>
 
+#include <algorithm>
 #include <vector>
 #include <chrono>
+#include <cstdio>
+#include <string>
 
 #include "shader.h"
 #include "glmutils.h"
 
 #include "primitives.h"
+#include "gpu_particles.h"
+#include "cpu_particles.h"
+#include "particle_sort.h"
+
+#include <render_queue.h>
+#include <frame_capture.h>
+#include <frame_pacer.h>
+#include <gpu_timer.h>
+#include <random.h>
+#include <stream_buffer.h>
 
 // application global variables
 float lastX, lastY;                             // used to compute delta movement of the mouse
 const unsigned int particlesCount = 10000;    // # of particles
-const unsigned int particleSize = 3;            // particle attributes
-const unsigned int sizeOfFloat = 4;             // bytes in a float
+bool compactParticles = true;                   // 16 bit unorm particle positions instead of 32 bit floats
+// the layer particles are sorted into CELLS_PER_AXIS^3 cells of the box; with cellCulling, the cells outside of the
+// view are not drawn and the particles thin out from a density of 1 at LOD_NEAR meters to LOD_MIN_DENSITY at LOD_FAR
+const unsigned int CELLS_PER_AXIS = 4;
+bool cellCulling = true;
+const float LOD_NEAR = 8.0f, LOD_FAR = 24.0f, LOD_MIN_DENSITY = 0.2f;
+unsigned int layerParticlesDrawn = 0;           // in all the layers, last frame
 unsigned int particleId = 0;                    // keep track of last particle to be updated
 float boxSize = 30; // Box size of 30m as defined in the paper
+const float simulationStep = 0.02f;             // seconds per simulation step
+// fraction of a step between the last simulation step and this frame (FramePacer::interpolation()); the particles
+// are drawn where they were that much before the last step, so that they move smoothly at any frame rate
+float stepInterpolation = 1.0f;
+bool depthSort = false;                         // draw the simulated points back to front
+// the depth sort is meant to run every frame within SORT_BUDGET_MS at SORT_TARGET_PARTICLES simulated particles
+// (the default count); it is timed while it runs, and turned off when it averages over the budget
+const float SORT_BUDGET_MS = 2.0f;
+const unsigned int SORT_TARGET_PARTICLES = 100000;
+const unsigned int SORT_BUDGET_FRAMES = 30;     // sorts averaged before the budget is checked
+unsigned int simulatedParticlesCount = SORT_TARGET_PARTICLES;  // # of particles of the per particle simulation
 
 // Create offsets and offset deltas for each simulation
 const unsigned int numberOfSimulations = 10;
 enum WeatherType {rain, snow, rainLine};
+// layers: copies of one static particle buffer scrolled by per layer offsets
+// gpu: every particle simulated on its own, in a transform feedback vertex shader
+// cpu: every particle simulated on its own, with AVX2 on all the cores, and streamed to the GPU every frame
+enum ParticleBackend {layers, gpu, cpu};
 
 struct ParticleOffsets{
     float gravityOffsets[numberOfSimulations];
@@ -40,18 +73,40 @@ struct SceneObject{
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES,  vertexCount, GL_UNSIGNED_INT, 0);
     }
+    // render queue version of drawSceneObject
+    RenderQueue::Draw makeDraw(unsigned int program) const{
+        RenderQueue::Draw draw;
+        draw.program = program;
+        draw.VAO = VAO;
+        draw.count = vertexCount;
+        return draw;
+    }
 };
 
+// Particles of the layers backend, stored once each in a buffer texture: the vertex shaders fetch the particle of
+// a vertex with gl_VertexID, so a point is one vertex and a line two vertices of the same particle, and the vertex
+// array has no attributes. The positions are fractions of the box, as RGBA32F or, compact, as RGBA16 unorm texels.
+// The w of a particle is its rank in [0, 1]: at a distance where the density is d, the particles of rank <= d are
+// drawn, so the same particles stay while the camera moves. The particles of a cell are next to each other in the
+// buffer, by increasing rank, so that the particles of a cell drawn at a given density are a range of the buffer.
 struct ParticlesObject{
     unsigned int VAO;
-    unsigned int vertexCount;
-    void drawParticlesObjectAsPoints() const{
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_POINTS, 0, vertexCount);
+    unsigned int buffer, texture;
+    unsigned int particleCount;
+    bool compact;
+    std::vector<unsigned int> cellFirst, cellCount;
+    std::vector<float> ranks;
+    unsigned int bytesPerParticle() const{
+        return compact ? 4 * sizeof(unsigned short) : 4 * sizeof(float);
     }
-    void drawParticlesObjectAsLines() const{
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_LINES, 0, vertexCount);
+    RenderQueue::Draw makeDraw(unsigned int program, GLenum mode) const{
+        RenderQueue::Draw draw;
+        draw.program = program;
+        draw.VAO = VAO;
+        draw.mode = mode;
+        draw.indexed = false;
+        draw.count = mode == GL_LINES ? particleCount * 2 : particleCount;
+        return draw;
     }
 };
 
@@ -67,11 +122,41 @@ std::vector<ParticleOffsets> particleOffsetsList;
 ParticleOffsets activeParticleOffsets;
 glm::mat4 previousViewProjectionModel;
 WeatherType currentWeatherType;
+RenderQueue renderQueue;
+FrameCapture* frameCapture;
+ParticleBackend currentBackend = ParticleBackend::layers;
+GpuParticles* gpuParticles;
+CpuParticles* cpuParticles;
+CpuParticleStream* cpuParticleStream;
+// depth sorts of the simulated points, on the CPU for the CPU simulation and on the GPU for the GPU simulation; the
+// GPU sort is created by the first sorted draw of the GPU simulation (and stays nullptr if the particles don't fit
+// in a buffer texture)
+ParticleDepthSort particleDepthSort;
+GpuParticleSort* gpuParticleSort;
+// times the GPU sort, created with it
+GpuTimer* gpuSortTimer;
+// average time of the sorts since the sort was turned on or the simulation was recreated, see checkSortBudget
+float sortMs = 0.0f;
+unsigned int sortSamples = 0;
+// per layer data of the layers backend, 2 RGBA32F texels per layer (combined offset, velocity), read by the
+// particle shaders at gl_InstanceID; bound to the first texture unit after the ones of the render queue.
+// The buffer texture covers the whole stream, the data of a frame starts at texel layerDataOffset of its region
+StreamBuffer* layerStream;
+unsigned int layerTexture;
+const unsigned int LAYER_TEXTURE_UNIT = RenderQueue::MAX_TEXTURES;
+const unsigned int PARTICLE_TEXTURE_UNIT = RenderQueue::MAX_TEXTURES + 1;
+// renders at 50 frames per second, and simulates in steps of 1/50 s whatever the frame rate
+FramePacer framePacer(0.02f);
+// every random number of the setup comes from this stream, so the same seed gives the same weather
+Random randomStream(1);
 
 // function declarations
 // ---------------------
 void setWeatherType(WeatherType);
-unsigned int createParticleVertexArray();
+void createParticlesObject(bool compact);
+float layerDensity(float distance);
+void addVisibleCells(RenderQueue::Draw &draw, const glm::vec3 &offset, const glm::vec3 &streak, const Frustum &frustum);
+void deleteParticlesObject();
 void initializeParticleOffsets();
 unsigned int createArrayBuffer(const std::vector<float> &array);
 unsigned int createElementArrayBuffer(const std::vector<unsigned int> &array);
@@ -79,7 +164,14 @@ unsigned int createVertexArray(const std::vector<float> &positions, const std::v
 float randBetween(float min, float max);
 void setup();
 void drawObjects();
+void updateParticles();
 void drawParticles();
+void drawSimulatedParticles(const glm::mat4 &viewProjection);
+void checkSortBudget(float ms);
+ParticleSimulationSettings simulationSettings();
+void createSimulations();
+void runParticleBenchmark();
+void runSortBenchmark();
 
 // glfw and input functions
 // ------------------------
@@ -87,6 +179,7 @@ void cursorInRange(float screenX, float screenY, int screenW, int screenH, float
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void cursor_input_callback(GLFWwindow* window, double posX, double posY);
+void key_input_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void drawCube(glm::mat4 model);
 
 // screen settings
@@ -126,14 +219,24 @@ float linearSpeed = 0.15f, rotationGain = 30.0f;
 
 
 
-int main()
+int main(int argc, char** argv)
 {
+    // 'assignment_weather_effects --benchmark' times the CPU simulation, without window nor GPU
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        runParticleBenchmark();
+        return 0;
+    }
+    // 'assignment_weather_effects --sort-benchmark' times the depth sorts, in a hidden window
+    bool sortBenchmark = argc > 1 && std::string(argv[1]) == "--sort-benchmark";
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (sortBenchmark)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
@@ -151,6 +254,7 @@ int main()
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, cursor_input_callback);
+    glfwSetKeyCallback(window, key_input_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
@@ -160,10 +264,20 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    if (sortBenchmark) {
+        runSortBenchmark();
+        glfwTerminate();
+        return 0;
+    }
     // setup mesh objects
     // ---------------------------------------
 
     setup();
+    frameCapture = new FrameCapture();
+    std::cout << "P - save a screenshot, R - start/stop recording a video" << std::endl;
+    std::cout << "V - switch between capped, vsync and uncapped frame rate, F - print the frame timings" << std::endl;
+    std::cout << "B - switch between the particle layers, the GPU and the CPU simulation, +/- - double/halve the simulated particles" << std::endl;
+    std::cout << "O - sort the simulated snow and rain points back to front" << std::endl;
 
     // set up the z-buffer
     // Notice that the depth range is now set to glDepthRange(-1,1), that is, a left handed coordinate system.
@@ -179,18 +293,22 @@ int main()
 
     // render loop
     // -----------
-    // render every loopInterval seconds
-    float loopInterval = 0.02f;
-    auto begin = std::chrono::high_resolution_clock::now();
+    // the camera speed and the particle offsets are tuned for steps of 0.02 seconds
+    framePacer.setFixedStep(simulationStep);
+    glfwSwapInterval(framePacer.swapInterval());
 
     while (!glfwWindowShouldClose(window))
     {
         // update current time
-        auto frameStart = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<float> appTime = frameStart - begin;
-        currentTime = appTime.count();
+        framePacer.beginFrame();
+        currentTime = framePacer.getTime();
 
-        processInput(window);
+        // simulation steps covered by the last frame
+        for (unsigned int step = framePacer.fixedSteps(); step > 0; step--) {
+            processInput(window);
+            updateParticles();
+        }
+        stepInterpolation = framePacer.interpolation();
 
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
 
@@ -199,7 +317,8 @@ int main()
 
         // Draw objects
         // ------------
-        sceneShaderProgram->use();
+        // the scene objects and the particle layers are submitted to the render queue,
+        // which draws the opaque objects first and then the blended particles
         drawObjects();
 
         // Draw particles
@@ -212,17 +331,29 @@ int main()
 
         drawParticles();
 
+        renderQueue.execute();
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        frameCapture->captureFrame(framebufferWidth, framebufferHeight);
+
         glfwSwapBuffers(window);
         glfwPollEvents();
 
         // control render loop frequency
-        std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now()-frameStart;
-        while (loopInterval > elapsed.count()) {
-            elapsed = std::chrono::high_resolution_clock::now() - frameStart;
-        }
+        framePacer.endFrame();
     }
 
     delete sceneShaderProgram;
+    delete frameCapture;
+    delete gpuParticles;
+    delete cpuParticles;
+    delete cpuParticleStream;
+    delete gpuParticleSort;
+    delete gpuSortTimer;
+    deleteParticlesObject();
+    glDeleteTextures(1, &layerTexture);
+    delete layerStream;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -244,8 +375,9 @@ void drawObjects(){
     glm::mat4 viewProjection = projection * view;
 
     // draw floor (the floor was built so that it does not need to be transformed)
-    sceneShaderProgram->setMat4("model", viewProjection);
-    floorObj.drawSceneObject();
+    RenderQueue::Draw floorDraw = floorObj.makeDraw(sceneShaderProgram->ID);
+    floorDraw.setUniforms = [viewProjection]() { sceneShaderProgram->setMat4("model", viewProjection); };
+    renderQueue.submit(RenderQueue::OPAQUE_PASS, 0.0f, floorDraw);
 
     // draw a cube
     drawCube(viewProjection * glm::translate(0.0f, 1.f, -4.0f) * glm::rotateY(glm::half_pi<float>()) * scale);
@@ -257,54 +389,287 @@ void drawParticles(){
     glm::mat4 viewMatrix = glm::lookAt(camPosition, camPosition + camForward, glm::vec3(0,1,0));
     glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
 
+    if (currentBackend != ParticleBackend::layers) {
+        drawSimulatedParticles(viewProjectionMatrix);
+        previousViewProjectionModel = viewProjectionMatrix;
+        return;
+    }
+
     // draw floor (the floor was built so that it does not need to be transformed)
     activeParticleShader->setMat4("model", viewProjectionMatrix);
 
+    glm::vec4 layerData[numberOfSimulations * 2];
+    // the offsets move by their deltas every step, between two steps they are blended linearly
+    float stepsBack = 1.0f - stepInterpolation;
     for(int i = 0; i < numberOfSimulations; i++){
-        // Update and calculate offset
-        activeParticleOffsets.gravityOffsets[i] += activeParticleOffsets.gravityOffsetDeltas[i];
-        activeParticleOffsets.xWindOffsets[i] += activeParticleOffsets.xWindOffsetDeltas[i];
-        activeParticleOffsets.zWindOffsets[i] += activeParticleOffsets.zWindOffsetDeltas[i];
-        glm::vec3 combinedOffset = glm::vec3(activeParticleOffsets.xWindOffsets[i], -activeParticleOffsets.gravityOffsets[i], activeParticleOffsets.zWindOffsets[i]);
+        // calculate offset
+        glm::vec3 combinedOffset = glm::vec3(activeParticleOffsets.xWindOffsets[i] - activeParticleOffsets.xWindOffsetDeltas[i] * stepsBack,
+                                             -(activeParticleOffsets.gravityOffsets[i] - activeParticleOffsets.gravityOffsetDeltas[i] * stepsBack),
+                                             activeParticleOffsets.zWindOffsets[i] - activeParticleOffsets.zWindOffsetDeltas[i] * stepsBack);
         combinedOffset -= camPosition + camForward + (boxSize/2);
         combinedOffset = glm::mod(combinedOffset, boxSize);
 
-        activeParticleShader->setVec3("combinedOffset", combinedOffset);
+        glm::vec3 velocity(activeParticleOffsets.xWindOffsetDeltas[i],
+                           -activeParticleOffsets.gravityOffsetDeltas[i],
+                           -activeParticleOffsets.zWindOffsetDeltas[i]);
+        layerData[i * 2] = glm::vec4(combinedOffset, 0.0f);
+        layerData[i * 2 + 1] = glm::vec4(velocity, 0.0f);
+    }
+    // to the region of this frame, the draws of the last frames may still read theirs
+    layerStream->beginFrame();
+    GLintptr layerDataBytes = layerStream->upload(layerData, sizeof(layerData), sizeof(glm::vec4));
+    int layerDataOffset = layerDataBytes < 0 ? 0 : (int) (layerDataBytes / sizeof(glm::vec4));
+
+    // set up by the render queue right before the draws are issued
+    glm::mat4 prevModel = previousViewProjectionModel;
+    float precipitationSize = currentWeatherType == WeatherType::rain ? RAIN_PRECIPITATION_SIZE : SNOW_PRECIPITATION_SIZE;
+    WeatherType weatherType = currentWeatherType;
+    Shader* shader = activeParticleShader;
+    unsigned int particleTexture = particlesObject.texture;
+    glm::vec3 lodParameters(LOD_NEAR, LOD_FAR, cellCulling ? LOD_MIN_DENSITY : 1.0f);
+    auto setLayerUniforms = [=]() {
+        GLState::bindTextureUnit(LAYER_TEXTURE_UNIT, GL_TEXTURE_BUFFER, layerTexture);
+        GLState::bindTextureUnit(PARTICLE_TEXTURE_UNIT, GL_TEXTURE_BUFFER, particleTexture);
+        shader->setInt("layerData", LAYER_TEXTURE_UNIT);
+        shader->setInt("layerDataOffset", layerDataOffset);
+        shader->setInt("particles", PARTICLE_TEXTURE_UNIT);
+        shader->setVec3("lodParameters", lodParameters);
+        if(weatherType == WeatherType::rainLine) {
+            shader->setMat4("prevModel", prevModel);
+            shader->setFloat("heightScale", 1.2);
+        }
+        else {
+            shader->setFloat("precipitationSize", precipitationSize);
+        }
+    };
+    GLenum mode = weatherType == WeatherType::rainLine ? GL_LINES : GL_POINTS;
+
+    if (!cellCulling) {
+        // all the particles of all the layers in one instanced draw
+        RenderQueue::Draw draw = particlesObject.makeDraw(shader->ID, mode);
+        draw.instanceCount = numberOfSimulations;
+        draw.setUniforms = [=]() {
+            setLayerUniforms();
+            shader->setInt("layerBase", 0);
+        };
+        renderQueue.submit(RenderQueue::BLENDED_PASS, 0.0f, draw);
+        layerParticlesDrawn = particlesObject.particleCount * numberOfSimulations;
+    }
+    else {
+        // each layer scrolls the cells to different places, so every layer is a draw of its own visible cells
+        Frustum frustum = Frustum::fromMatrix(viewProjectionMatrix);
+        layerParticlesDrawn = 0;
+        for (int i = 0; i < (int) numberOfSimulations; i++) {
+            RenderQueue::Draw draw = particlesObject.makeDraw(shader->ID, mode);
+            glm::vec3 streak = weatherType == WeatherType::rainLine ? glm::vec3(layerData[i * 2 + 1]) * 1.2f : glm::vec3(0.0f);
+            addVisibleCells(draw, glm::vec3(layerData[i * 2]), streak, frustum);
+            if (draw.firsts.empty())
+                continue;
+            draw.setUniforms = [=]() {
+                setLayerUniforms();
+                shader->setInt("layerBase", i);
+            };
+            renderQueue.submit(RenderQueue::BLENDED_PASS, 0.0f, draw);
+        }
+    }
+    previousViewProjectionModel = viewProjectionMatrix;
+}
 
-        if(currentWeatherType == WeatherType::rainLine) {
-            activeParticleShader->setMat4("prevModel", previousViewProjectionModel);
-            activeParticleShader->setFloat("heightScale", 1.2);
-            activeParticleShader->setVec3("g_vVelocity", glm::vec3(activeParticleOffsets.xWindOffsetDeltas[i],
-                                                                   -activeParticleOffsets.gravityOffsetDeltas[i],
-                                                                   -activeParticleOffsets.zWindOffsetDeltas[i]));
-            particlesObject.drawParticlesObjectAsLines();
+// density of the layer particles at 'distance' from the camera, as in the particle shaders
+float layerDensity(float distance){
+    return glm::mix(1.0f, LOD_MIN_DENSITY, glm::clamp((distance - LOD_NEAR) / (LOD_FAR - LOD_NEAR), 0.0f, 1.0f));
+}
+
+// appends to the ranges of 'draw' the cells of a layer scrolled by 'offset' that are in 'frustum', each cut down to
+// the particles drawn at the density of its closest point to the camera; 'streak' is the extent of the rain lines
+void addVisibleCells(RenderQueue::Draw &draw, const glm::vec3 &offset, const glm::vec3 &streak, const Frustum &frustum){
+    float cellSize = boxSize / CELLS_PER_AXIS;
+    // the shaders add this to the scrolled positions, which wrap around in [0, boxSize)
+    glm::vec3 boxMin = camPosition - boxSize / 2;
+    // large points near the camera may reach out of their cell
+    glm::vec3 margin(0.5f);
+    unsigned int verticesPerParticle = draw.mode == GL_LINES ? 2 : 1;
+
+    for (unsigned int cell = 0; cell < particlesObject.cellFirst.size(); cell++) {
+        unsigned int index[3] = {cell % CELLS_PER_AXIS, cell / CELLS_PER_AXIS % CELLS_PER_AXIS, cell / (CELLS_PER_AXIS * CELLS_PER_AXIS)};
+        // once scrolled, a cell that crosses the end of the box on an axis is in two pieces along that axis
+        float pieceMin[3][2], pieceMax[3][2];
+        unsigned int pieces[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float start = glm::mod(index[axis] * cellSize + offset[axis], boxSize);
+            pieceMin[axis][0] = start;
+            pieceMax[axis][0] = std::min(start + cellSize, boxSize);
+            pieceMin[axis][1] = 0.0f;
+            pieceMax[axis][1] = start + cellSize - boxSize;
+            pieces[axis] = start + cellSize > boxSize ? 2 : 1;
         }
+
+        bool visible = false;
+        float closest = boxSize * 2;
+        for (unsigned int x = 0; x < pieces[0]; x++)
+            for (unsigned int y = 0; y < pieces[1]; y++)
+                for (unsigned int z = 0; z < pieces[2]; z++) {
+                    glm::vec3 min = boxMin + glm::vec3(pieceMin[0][x], pieceMin[1][y], pieceMin[2][z]);
+                    glm::vec3 max = boxMin + glm::vec3(pieceMax[0][x], pieceMax[1][y], pieceMax[2][z]);
+                    min += glm::min(streak, glm::vec3(0.0f)) - margin;
+                    max += glm::max(streak, glm::vec3(0.0f)) + margin;
+                    if (!frustum.intersectsBox(min, max))
+                        continue;
+                    visible = true;
+                    closest = std::min(closest, glm::distance(camPosition, glm::clamp(camPosition, min, max)));
+                }
+        if (!visible)
+            continue;
+
+        // the particles of the cell by increasing rank, the ones drawn at the density of the closest point
+        unsigned int first = particlesObject.cellFirst[cell];
+        std::vector<float>::const_iterator ranks = particlesObject.ranks.begin() + first;
+        unsigned int count = (unsigned int) (std::upper_bound(ranks, ranks + particlesObject.cellCount[cell], layerDensity(closest)) - ranks);
+        if (count == 0)
+            continue;
+        layerParticlesDrawn += count;
+
+        GLint firstVertex = first * verticesPerParticle;
+        GLsizei vertexCount = count * verticesPerParticle;
+        // cells drawn whole join the range of the cell before them
+        if (!draw.firsts.empty() && draw.firsts.back() + draw.counts.back() == firstVertex)
+            draw.counts.back() += vertexCount;
         else {
-            if(currentWeatherType == WeatherType::rain){
-                activeParticleShader->setFloat("precipitationSize", RAIN_PRECIPITATION_SIZE);
-            } else {
-                activeParticleShader->setFloat("precipitationSize", SNOW_PRECIPITATION_SIZE);
+            draw.firsts.push_back(firstVertex);
+            draw.counts.push_back(vertexCount);
+        }
+    }
+}
+
+
+// all the particles of the simulation in one draw, their positions are already in world space; with depthSort,
+// the points are drawn back to front, so that they blend over each other in the right order (the lines are one
+// instance per particle, which an index buffer can't reorder)
+void drawSimulatedParticles(const glm::mat4 &viewProjection){
+    bool asLines = currentWeatherType == WeatherType::rainLine;
+    Shader* shader = &particleShaderPrograms[asLines ? 3 : 2];
+    glm::mat4 prevModel = previousViewProjectionModel;
+    float precipitationSize = currentWeatherType == WeatherType::rain ? RAIN_PRECIPITATION_SIZE : SNOW_PRECIPITATION_SIZE;
+    glm::vec3 cameraPosition = camPosition;
+    // the shaders move the particles back along their velocity, from the last step to this frame
+    float interpolationTime = (1.0f - stepInterpolation) * simulationStep;
+    bool sort = depthSort && !asLines;
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    glm::vec3 forward = glm::normalize(camForward);
+
+    RenderQueue::Draw draw;
+    if (currentBackend == ParticleBackend::cpu) {
+        // the state after the last simulation step of the frame
+        cpuParticleStream->upload(*cpuParticles);
+        if (sort) {
+            auto start = std::chrono::steady_clock::now();
+            // the particles don't leave the box, boxSize covers their depths
+            unsigned int visible = particleDepthSort.sort(cpuParticles->getArray(CpuParticles::X), cpuParticles->getArray(CpuParticles::Y),
+                                                          cpuParticles->getArray(CpuParticles::Z), cpuParticles->getCount(),
+                                                          frustum, camPosition, forward, boxSize);
+            checkSortBudget(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+            cpuParticleStream->uploadIndices(particleDepthSort.getIndices(), visible);
+        }
+        draw = cpuParticleStream->makeDraw(shader->ID, asLines ? GL_LINES : GL_POINTS);
+    }
+    else {
+        if (sort && !gpuParticleSort) {
+            if (GpuParticleSort::fits(simulatedParticlesCount)) {
+                gpuParticleSort = new GpuParticleSort(simulatedParticlesCount);
+                gpuSortTimer = new GpuTimer();
+            }
+            else {
+                depthSort = sort = false;
+                std::cout << "depth sort off: " << simulatedParticlesCount << " particles don't fit in the buffer textures of the GPU sort" << std::endl;
             }
-            particlesObject.drawParticlesObjectAsPoints();
         }
+        if (sort) {
+            gpuSortTimer->begin();
+            gpuParticleSort->sort(gpuParticles->getBuffer(), frustum, camPosition, forward, boxSize);
+            gpuSortTimer->end();
+            // the timer reads its queries a few frames late, 0 until the first one is back
+            if (gpuSortTimer->lastMs > 0.0f)
+                checkSortBudget(gpuSortTimer->lastMs);
+        }
+        draw = gpuParticles->makeDraw(shader->ID, asLines ? GL_LINES : GL_POINTS, sort ? gpuParticleSort->getIndexBuffer() : 0);
+    }
+    draw.setUniforms = [=]() {
+        shader->setMat4("model", viewProjection);
+        shader->setFloat("interpolationTime", interpolationTime);
+        if (asLines) {
+            shader->setMat4("prevModel", prevModel);
+            // same streak length as the layers, 1.2 simulation steps
+            shader->setFloat("streakTime", 1.2f * simulationStep);
+        }
+        else {
+            shader->setVec3("camPosition", cameraPosition);
+            shader->setFloat("precipitationSize", precipitationSize);
+        }
+    };
+    renderQueue.submit(RenderQueue::BLENDED_PASS, 0.0f, draw);
+}
 
+// averages the times of the sorts, and turns the sort off (with a message) once the average is over the budget
+void checkSortBudget(float ms){
+    sortMs = sortSamples++ == 0 ? ms : sortMs * 0.9f + ms * 0.1f;
+    if (sortSamples < SORT_BUDGET_FRAMES || sortMs <= SORT_BUDGET_MS)
+        return;
+    depthSort = false;
+    std::cout << "depth sort off: " << sortMs << " ms per frame for " << simulatedParticlesCount << " particles is over the "
+              << SORT_BUDGET_MS << " ms budget (" << SORT_TARGET_PARTICLES << " particles are the target)" << std::endl;
+}
 
+// the per step deltas of the layers, as speeds of the per particle simulation
+ParticleSimulationSettings simulationSettings(){
+    ParticleSimulationSettings settings;
+    float minGravity = GRAVITY_MIN_RAIN, maxGravity = GRAVITY_MAX_RAIN, minWind = WIND_MIN_RAIN, maxWind = WIND_MAX_RAIN;
+    if (currentWeatherType == WeatherType::snow) {
+        minGravity = GRAVITY_MIN_SNOW; maxGravity = GRAVITY_MAX_SNOW; minWind = WIND_MIN_SNOW; maxWind = WIND_MAX_SNOW;
+    }
+    else if (currentWeatherType == WeatherType::rainLine) {
+        minGravity = GRAVITY_MIN_LINE_RAIN; maxGravity = GRAVITY_MAX_LINE_RAIN; minWind = WIND_MIN_LINE_RAIN; maxWind = WIND_MAX_LINE_RAIN;
+    }
+    settings.minFallSpeed = minGravity / simulationStep;
+    settings.maxFallSpeed = maxGravity / simulationStep;
+    settings.wind = glm::vec3((minWind + maxWind) * 0.5f / simulationStep, 0.0f, 0.0f);
+    // the gusts vary the wind as much as the layers differ from each other
+    settings.turbulence = (maxWind - minWind) / simulationStep;
+    // snow floats around longer
+    settings.minLifetime = currentWeatherType == WeatherType::snow ? 5.0f : 2.0f;
+    settings.maxLifetime = settings.minLifetime * 3.0f;
+    settings.boxCenter = camPosition;
+    settings.boxSize = boxSize;
+    return settings;
+}
+
+// one simulation step, the offsets move by their deltas
+void updateParticles(){
+    if (currentBackend == ParticleBackend::gpu) {
+        gpuParticles->update(simulationSettings(), simulationStep, currentTime);
+        return;
+    }
+    if (currentBackend == ParticleBackend::cpu) {
+        cpuParticles->update(simulationSettings(), simulationStep);
+        return;
+    }
+    for(int i = 0; i < numberOfSimulations; i++){
+        activeParticleOffsets.gravityOffsets[i] += activeParticleOffsets.gravityOffsetDeltas[i];
+        activeParticleOffsets.xWindOffsets[i] += activeParticleOffsets.xWindOffsetDeltas[i];
+        activeParticleOffsets.zWindOffsets[i] += activeParticleOffsets.zWindOffsetDeltas[i];
     }
-    previousViewProjectionModel = viewProjectionMatrix;
 }
 
 
 void drawCube(glm::mat4 model){
     // draw object
-    sceneShaderProgram->setMat4("model", model);
-    cube.drawSceneObject();
+    RenderQueue::Draw draw = cube.makeDraw(sceneShaderProgram->ID);
+    draw.setUniforms = [model]() { sceneShaderProgram->setMat4("model", model); };
+    // sort by distance to the camera, the model matrix already includes the view projection
+    renderQueue.submit(RenderQueue::OPAQUE_PASS, (model * glm::vec4(0, 0, 0, 1)).w, draw);
 }
 
 float randBetween(float min, float max){
-    float random = ((float) rand()) / (float) RAND_MAX;
-    float diff = max - min;
-    float r = random * diff;
-    return min + r;
+    return randomStream.between(min, max);
 }
 
 
@@ -326,12 +691,134 @@ void setup(){
 
     particleShaderPrograms.push_back(Shader("shaders/particlePointShader.vert", "shaders/particlePointShader.frag"));
     particleShaderPrograms.push_back(Shader("shaders/particleLineShader.vert", "shaders/particleLineShader.frag"));
-
-    particlesObject.VAO = createParticleVertexArray();
+    // versions for the per particle simulation, which draws world space particles
+    particleShaderPrograms.push_back(Shader("shaders/particleSimulatedPoint.vert", "shaders/particlePointShader.frag"));
+    particleShaderPrograms.push_back(Shader("shaders/particleSimulatedLine.vert", "shaders/particleLineShader.frag"));
+
+    createParticlesObject(compactParticles);
+    layerStream = new StreamBuffer(numberOfSimulations * 2 * sizeof(glm::vec4));
+    glGenTextures(1, &layerTexture);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, layerTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, layerStream->ID);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, 0);
+    createSimulations();
     initializeParticleOffsets();
     setWeatherType(WeatherType::rainLine);
 }
 
+// (re)create the simulation of the current backend with simulatedParticlesCount particles, which all spawn on their
+// next update; the backends not in use are released, at millions of particles each of them takes hundreds of MB
+void createSimulations(){
+    delete gpuParticles;
+    delete cpuParticles;
+    delete cpuParticleStream;
+    delete gpuParticleSort;
+    delete gpuSortTimer;
+    gpuParticles = nullptr;
+    cpuParticles = nullptr;
+    cpuParticleStream = nullptr;
+    // recreated for the new count by the next sorted draw, if any, and timed again
+    gpuParticleSort = nullptr;
+    gpuSortTimer = nullptr;
+    sortSamples = 0;
+    if (currentBackend == ParticleBackend::gpu)
+        gpuParticles = new GpuParticles(simulatedParticlesCount);
+    if (currentBackend == ParticleBackend::cpu) {
+        cpuParticles = new CpuParticles(simulatedParticlesCount);
+        cpuParticleStream = new CpuParticleStream(simulatedParticlesCount);
+    }
+}
+
+// nanoseconds per particle of a simulation step and of the copy to the vertex layout, from 10 thousand to 10 million
+// particles, with the AVX2 kernels and without
+void runParticleBenchmark(){
+    ParticleSimulationSettings settings = simulationSettings();
+    std::cout << "CPU particle simulation, " << JobSystem::instance().threadCount() << " threads" << std::endl;
+    std::cout << "particles    kernel   update (ns/particle/step)   write vertices (ns/particle)" << std::endl;
+    for (unsigned int count = 10000; count <= 10000000; count *= 10) {
+        CpuParticles particles(count);
+        std::vector<SimulatedParticle> vertices(count);
+        // enough steps for about 100 million particle updates
+        unsigned int steps = std::max(10u, 100000000u / count);
+        for (int avx2 = 1; avx2 >= 0; avx2--) {
+            particles.setUseAvx2(avx2 != 0);
+            if (avx2 && !particles.isUsingAvx2())
+                continue;
+            // the first updates spawn the particles
+            for (int i = 0; i < 3; i++)
+                particles.update(settings, simulationStep);
+
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < steps; i++)
+                particles.update(settings, simulationStep);
+            auto updated = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < steps; i++)
+                particles.writeVertices(vertices.data());
+            auto written = std::chrono::steady_clock::now();
+
+            double updateNs = std::chrono::duration<double, std::nano>(updated - start).count() / ((double) count * steps);
+            double writeNs = std::chrono::duration<double, std::nano>(written - updated).count() / ((double) count * steps);
+            std::printf("%9u    %-6s   %25.3f   %28.3f\n", count, avx2 ? "AVX2" : "scalar", updateNs, writeNs);
+        }
+    }
+}
+
+// milliseconds per depth sort of 100 thousand to 1 million particles spread over the box around the camera,
+// with the radix sort on the CPU and the bitonic sort on the GPU
+void runSortBenchmark(){
+    ParticleSimulationSettings settings = simulationSettings();
+    glm::mat4 projection = glm::perspectiveFov(70.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, .01f, 100.0f);
+    Frustum frustum = Frustum::fromMatrix(projection * glm::lookAt(camPosition, camPosition + camForward, glm::vec3(0,1,0)));
+    glm::vec3 forward = glm::normalize(camForward);
+    const unsigned int sorts = 20;
+
+    // the CPU sort runs on all the threads of the job system, as it does in the render loop
+    unsigned int threads = JobSystem::instance().threadCount();
+    std::cout << "particle depth sort, " << threads << " threads, " << glGetString(GL_RENDERER) << std::endl;
+    std::cout << "budget " << SORT_BUDGET_MS << " ms per frame at " << SORT_TARGET_PARTICLES << " particles, * marks the sorts over it" << std::endl;
+    if (threads == 1)
+        std::cout << "only one thread: the CPU times are those of a single core" << std::endl;
+    std::cout << "particles    visible   CPU radix (ms)   GPU bitonic (ms)   bitonic passes" << std::endl;
+    auto overBudget = [](double ms) { return ms > SORT_BUDGET_MS ? '*' : ' '; };
+    for (unsigned int count : {100000u, 250000u, 500000u, 1000000u}) {
+        CpuParticles particles(count);
+        // the first update spawns the particles
+        particles.update(settings, simulationStep);
+        std::vector<SimulatedParticle> vertices(count);
+        particles.writeVertices(vertices.data());
+
+        unsigned int visible = particleDepthSort.sort(particles.getArray(CpuParticles::X), particles.getArray(CpuParticles::Y),
+                                                      particles.getArray(CpuParticles::Z), count, frustum, camPosition, forward, boxSize);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < sorts; i++)
+            particleDepthSort.sort(particles.getArray(CpuParticles::X), particles.getArray(CpuParticles::Y),
+                                   particles.getArray(CpuParticles::Z), count, frustum, camPosition, forward, boxSize);
+        double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / sorts;
+
+        if (!GpuParticleSort::fits(count)) {
+            std::printf("%9u  %9u   %13.3f%c   %16s   %14s\n", count, visible, cpuMs, overBudget(cpuMs), "-", "-");
+            continue;
+        }
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(SimulatedParticle), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GpuParticleSort gpuSort(count);
+        // the first sort compiles and allocates behind the scenes
+        gpuSort.sort(buffer, frustum, camPosition, forward, boxSize);
+        glFinish();
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < sorts; i++)
+            gpuSort.sort(buffer, frustum, camPosition, forward, boxSize);
+        glFinish();
+        double gpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / sorts;
+        glDeleteBuffers(1, &buffer);
+        std::printf("%9u  %9u   %13.3f%c   %15.3f%c   %14u\n", count, visible, cpuMs, overBudget(cpuMs), gpuMs, overBudget(gpuMs),
+                    gpuSort.getPassCount());
+    }
+}
+
 void initializeParticleOffsets(){
 
     particleOffsetsList.push_back(ParticleOffsets());
@@ -373,42 +860,76 @@ void initializeParticleOffsets(){
     }
 }
 
-unsigned int createParticleVertexArray() {
-    unsigned int VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    // initialize particle buffer, set all values to 0
-    // Duplicate points for when drawing rain as lines
-    std::vector<float> data(particlesCount * 2 * particleSize);
-    for (unsigned int i = 0; i < data.size(); i += 2 * particleSize){
-        float x = randBetween(-15, 15);
-        float y = randBetween(-15, 15);
-        float z = randBetween(-15, 15);
-        // x, y, z
-        data[i] = x;
-        data[i+1] = y;
-        data[i+2] = z;
-        // x, y, z for other end of line
-        data[i+3] = x;
-        data[i+4] = y;
-        data[i+5] = z;
-    }
-    // Update how many vertices should be drawn
-    particlesObject.vertexCount = data.size();
-
-    // allocate at openGL controlled memory
-    glBufferData(GL_ARRAY_BUFFER, particlesCount * 2 * particleSize * sizeOfFloat, &data[0], GL_DYNAMIC_DRAW);
-
-    // Bind position attribute
-    int posSize = 3; // each position has x,y,z
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, posSize, GL_FLOAT, GL_FALSE, 0, 0);
+void createParticlesObject(bool compact) {
+    particlesObject.particleCount = particlesCount;
+    particlesObject.compact = compact;
+
+    // random positions in the box, as fractions of its size (the shaders scale them by boxSize), and random ranks;
+    // compact, they are rounded to what the shaders read, so that they fall in the same cells
+    struct Particle { unsigned int cell; glm::vec4 data; };
+    std::vector<Particle> particles(particlesCount);
+    std::vector<float> values(particlesCount * 4);
+    RandomBatch batch(randomStream);
+    batch.fill(values.data(), values.size(), 0.0f, 1.0f);
+    for (unsigned int i = 0; i < particlesCount; i++){
+        Particle &particle = particles[i];
+        for (int j = 0; j < 4; j++) {
+            float value = values[i * 4 + j];
+            if (compact)
+                value = std::floor(value * 65535.0f + 0.5f) / 65535.0f;
+            particle.data[j] = value;
+        }
+        unsigned int index[3];
+        for (int j = 0; j < 3; j++) {
+            // 1 is the same place as 0 once wrapped around the box
+            if (particle.data[j] >= 1.0f)
+                particle.data[j] = 0.0f;
+            index[j] = std::min((unsigned int) (particle.data[j] * CELLS_PER_AXIS), CELLS_PER_AXIS - 1);
+        }
+        particle.cell = index[0] + (index[1] + index[2] * CELLS_PER_AXIS) * CELLS_PER_AXIS;
+    }
+    std::sort(particles.begin(), particles.end(), [](const Particle &a, const Particle &b) {
+        return a.cell != b.cell ? a.cell < b.cell : a.data.w < b.data.w;
+    });
+
+    unsigned int cellCount = CELLS_PER_AXIS * CELLS_PER_AXIS * CELLS_PER_AXIS;
+    particlesObject.cellFirst.assign(cellCount, 0);
+    particlesObject.cellCount.assign(cellCount, 0);
+    particlesObject.ranks.resize(particlesCount);
+    std::vector<float> data(particlesCount * 4);
+    std::vector<unsigned short> compactData(compact ? particlesCount * 4 : 0);
+    for (unsigned int i = particlesCount; i-- > 0;){
+        particlesObject.cellFirst[particles[i].cell] = i;
+        particlesObject.cellCount[particles[i].cell]++;
+        particlesObject.ranks[i] = particles[i].data.w;
+        for (unsigned int j = 0; j < 4; j++) {
+            data[i * 4 + j] = particles[i].data[j];
+            if (compact)
+                compactData[i * 4 + j] = (unsigned short) (particles[i].data[j] * 65535.0f + 0.5f);
+        }
+    }
+    unsigned int size = particlesCount * particlesObject.bytesPerParticle();
+    const void* bufferData = compact ? (const void*) compactData.data() : (const void*) data.data();
+
+    glGenVertexArrays(1, &particlesObject.VAO);
+    glGenBuffers(1, &particlesObject.buffer);
+    glGenTextures(1, &particlesObject.texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, particlesObject.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, bufferData, GL_STATIC_DRAW);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, particlesObject.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, compact ? GL_RGBA16 : GL_RGBA32F, particlesObject.buffer);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    std::cout << "layer particles: " << particlesCount << " x " << particlesObject.bytesPerParticle() << " bytes ("
+              << (compact ? "16 bit unorm" : "32 bit float") << "), " << size / 1024 << " KB" << std::endl;
+}
 
-    return VAO;
+void deleteParticlesObject() {
+    glDeleteVertexArrays(1, &particlesObject.VAO);
+    glDeleteTextures(1, &particlesObject.texture);
+    glDeleteBuffers(1, &particlesObject.buffer);
+    GLState::invalidate();
 }
 
 
@@ -551,6 +1072,74 @@ void processInput(GLFWwindow *window) {
 }
 
 
+// screenshots and videos are written to the working directory
+void key_input_callback(GLFWwindow* window, int key, int scancode, int action, int mods){
+    static unsigned int screenshotCount = 0, videoCount = 0;
+    if (action != GLFW_PRESS)
+        return;
+    if (key == GLFW_KEY_P)
+        frameCapture->screenshot("screenshot_" + std::to_string(screenshotCount++) + ".png");
+    if (key == GLFW_KEY_R) {
+        if (frameCapture->isRecording()) {
+            frameCapture->stopRecording();
+            std::cout << "recorded " << frameCapture->recordedFrames << " frames, "
+                      << frameCapture->droppedFrames << " dropped" << std::endl;
+        }
+        else
+            // the frame rate of the pacer, when it is capped
+            frameCapture->startRecording("capture_" + std::to_string(videoCount++) + ".y4m",
+                                         (unsigned int) (1.0f / framePacer.getInterval() + 0.5f));
+    }
+    if (key == GLFW_KEY_B) {
+        static const char* backendNames[] = {"layers", "GPU simulation", "CPU simulation"};
+        currentBackend = (ParticleBackend) ((currentBackend + 1) % 3);
+        createSimulations();
+        std::cout << "particles: " << backendNames[currentBackend] << std::endl;
+    }
+    if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS) && currentBackend != ParticleBackend::layers) {
+        if (key == GLFW_KEY_EQUAL)
+            simulatedParticlesCount = std::min(simulatedParticlesCount * 2, 1u << 24);
+        else
+            simulatedParticlesCount = std::max(simulatedParticlesCount / 2, 1000u);
+        createSimulations();
+        std::cout << simulatedParticlesCount << " simulated particles" << std::endl;
+    }
+    if (key == GLFW_KEY_C) {
+        compactParticles = !compactParticles;
+        deleteParticlesObject();
+        createParticlesObject(compactParticles);
+    }
+    if (key == GLFW_KEY_O) {
+        depthSort = !depthSort;
+        sortSamples = 0;
+        std::cout << "depth sort of the simulated points: " << (depthSort ? "on" : "off") << std::endl;
+        if (depthSort && simulatedParticlesCount > SORT_TARGET_PARTICLES)
+            std::cout << "more particles than the " << SORT_TARGET_PARTICLES << " the sort is meant for, it turns off if it takes more than "
+                      << SORT_BUDGET_MS << " ms" << std::endl;
+    }
+    if (key == GLFW_KEY_L) {
+        cellCulling = !cellCulling;
+        std::cout << "layer cell culling and thinning: " << (cellCulling ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_V) {
+        static const char* modeNames[] = {"capped", "vsync", "uncapped"};
+        framePacer.setMode((FramePacer::Mode) ((framePacer.getMode() + 1) % 3));
+        glfwSwapInterval(framePacer.swapInterval());
+        std::cout << "frame rate: " << modeNames[framePacer.getMode()] << std::endl;
+    }
+    if (key == GLFW_KEY_F) {
+        FramePacer::Stats stats = framePacer.getStats();
+        std::cout << "frame " << stats.frameMs << " ms (jitter " << stats.jitterMs << " ms, max " << stats.maxFrameMs
+                  << " ms), sleep error " << stats.sleepErrorMs << " +- " << stats.sleepErrorDeviationMs
+                  << " ms, spin " << stats.spinMs << " ms per frame, " << stats.missedFrames << " of "
+                  << stats.frames << " frames late" << std::endl;
+        if (currentBackend == ParticleBackend::layers)
+            std::cout << "layer particles drawn: " << layerParticlesDrawn << " of "
+                      << particlesObject.particleCount * numberOfSimulations << std::endl;
+    }
+}
+
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -0,0 +1,43 @@
+//
+// Per particle simulation of the precipitation: settings and vertex layout shared by the simulation backends.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_PARTICLE_SIMULATION_H
+#define ITU_GRAPHICS_PROGRAMMING_PARTICLE_SIMULATION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// The particles fall at their own speed, are pushed by the wind plus a turbulence that varies in space and time,
+// and live inside a box of side boxSize centered at boxCenter (the camera): a particle that leaves the box comes
+// back from the opposite side, and a particle older than its lifetime is respawned at a random place in the box.
+struct ParticleSimulationSettings {
+    float minFallSpeed = 25.0f, maxFallSpeed = 35.0f; // m/s
+    glm::vec3 wind = glm::vec3(3.75f, 0.0f, 0.0f);    // m/s
+    float turbulence = 1.0f;                          // strength of the gusts, m/s
+    float minLifetime = 2.0f, maxLifetime = 6.0f;     // seconds
+    glm::vec3 boxCenter = glm::vec3(0.0f);
+    float boxSize = 30.0f;
+};
+
+// vertex of a simulated particle, as the backends leave it in the vertex buffer that is drawn
+struct SimulatedParticle {
+    glm::vec3 position;
+    float age;        // seconds since the particle was spawned
+    glm::vec3 velocity;
+    float lifetime;   // age at which it is respawned
+};
+
+// attributes 0 (position, age) and 1 (velocity, lifetime) of the vertex array bound now, read from 'buffer'
+// starting at 'offset'; with divisor 1 every instance of a draw gets a particle (e.g. one GL_LINES segment per particle)
+inline void setupSimulatedParticleAttributes(GLuint buffer, GLuint divisor, GLintptr offset = 0){
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*) offset);
+    glVertexAttribDivisor(0, divisor);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SimulatedParticle), (void*) (offset + 4 * sizeof(float)));
+    glVertexAttribDivisor(1, divisor);
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_PARTICLE_SIMULATION_H
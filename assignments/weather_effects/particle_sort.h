@@ -0,0 +1,368 @@
+//
+// Depth sort of the simulated particles, so that the blended particles are drawn back to front.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_PARTICLE_SORT_H
+#define ITU_GRAPHICS_PROGRAMMING_PARTICLE_SORT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <frustum.h>
+#include <gl_state.h>
+#include <job_system.h>
+#include <profiler.h>
+#include <program_cache.h>
+
+#include "particle_simulation.h"
+
+// Both sorts order the particles by a 16 bit key: their depth along the view direction, over [0, range] meters,
+// reversed so that increasing keys go from the back to the front. Equal keys keep the order of the particles.
+// They run every frame, so main.cpp holds them to a budget of SORT_BUDGET_MS at SORT_TARGET_PARTICLES particles
+// and turns the sort off when it gets slower than that; 'assignment_weather_effects --sort-benchmark' times both.
+
+// CPU sort: LSD radix sort of the keys in two passes of 8 bits, on the cores of the JobSystem. The particles are
+// split in chunks of CHUNK; each chunk counts its digits, a prefix sum over (digit, chunk) gives every chunk the
+// place of its particles, and the chunks scatter them in parallel, which keeps the sort stable. The particles
+// outside of the view frustum are dropped by the first pass, so the second one only moves the visible ones.
+class ParticleDepthSort
+{
+public:
+    static const unsigned int CHUNK = 16384; // particles per job
+
+    // sorts the particles at (x[i], y[i], z[i]) inside 'frustum' by their depth from 'eye' along 'forward'
+    // (normalized); returns how many are visible, their indices are the first ones of getIndices()
+    unsigned int sort(const float* x, const float* y, const float* z, unsigned int count, const Frustum &frustum,
+                      const glm::vec3 &eye, const glm::vec3 &forward, float range)
+    {
+        PROFILE_SCOPE("ParticleDepthSort::sort");
+        keys.resize(count);
+        sortedKeys.resize(count);
+        indices.resize(count);
+        sortedIndices.resize(count);
+        float scale = 65535.0f / range;
+
+        // keys, and the low digits of the visible particles
+        unsigned int chunks = (count + CHUNK - 1) / CHUNK;
+        histograms.assign(chunks * BINS, 0);
+        JobSystem::instance().parallelFor(0, chunks, 1, [&](unsigned int begin, unsigned int end) {
+            glm::vec4 planes[6];
+            std::copy(frustum.planes, frustum.planes + 6, planes);
+            for (unsigned int chunk = begin; chunk < end; chunk++)
+            {
+                unsigned int first = chunk * CHUNK, last = std::min(count, first + CHUNK);
+                // without branches, so that it vectorizes
+                std::uint32_t* chunkKeys = keys.data();
+                for (unsigned int i = first; i < last; i++)
+                {
+                    bool inside = true;
+                    for (const glm::vec4 &plane : planes)
+                        inside &= plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w >= 0.0f;
+                    float depth = (x[i] - eye.x) * forward.x + (y[i] - eye.y) * forward.y + (z[i] - eye.z) * forward.z;
+                    std::uint32_t key = 65535u - (std::uint32_t) std::min(std::max(depth, 0.0f) * scale, 65535.0f);
+                    chunkKeys[i] = inside ? key : CULLED;
+                }
+                unsigned int* histogram = &histograms[chunk * BINS];
+                for (unsigned int i = first; i < last; i++)
+                    histogram[lowDigit(chunkKeys[i])]++;
+            }
+        });
+        unsigned int visible = prefixSum(chunks);
+        JobSystem::instance().parallelFor(0, chunks, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int chunk = begin; chunk < end; chunk++)
+            {
+                unsigned int* offsets = &histograms[chunk * BINS];
+                unsigned int last = std::min(count, (chunk + 1) * CHUNK);
+                for (unsigned int i = chunk * CHUNK; i < last; i++)
+                {
+                    std::uint32_t key = keys[i];
+                    if (key == CULLED)
+                        continue;
+                    unsigned int destination = offsets[key & 0xFF]++;
+                    sortedKeys[destination] = key;
+                    sortedIndices[destination] = i;
+                }
+            }
+        });
+
+        // the high digits, of the particles in front only
+        chunks = (visible + CHUNK - 1) / CHUNK;
+        histograms.assign(chunks * BINS, 0);
+        JobSystem::instance().parallelFor(0, chunks, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int chunk = begin; chunk < end; chunk++)
+            {
+                unsigned int* histogram = &histograms[chunk * BINS];
+                unsigned int last = std::min(visible, (chunk + 1) * CHUNK);
+                for (unsigned int i = chunk * CHUNK; i < last; i++)
+                    histogram[sortedKeys[i] >> 8]++;
+            }
+        });
+        prefixSum(chunks);
+        JobSystem::instance().parallelFor(0, chunks, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int chunk = begin; chunk < end; chunk++)
+            {
+                unsigned int* offsets = &histograms[chunk * BINS];
+                unsigned int last = std::min(visible, (chunk + 1) * CHUNK);
+                for (unsigned int i = chunk * CHUNK; i < last; i++)
+                {
+                    // the keys are not needed anymore
+                    indices[offsets[sortedKeys[i] >> 8]++] = sortedIndices[i];
+                }
+            }
+        });
+        return visible;
+    }
+
+    // indices of the particles, back to front, after sort()
+    const std::uint32_t* getIndices() const { return indices.data(); }
+
+private:
+    // key of the particles outside of the frustum, counted in the last bin of the first pass
+    static const std::uint32_t CULLED = 0x10000;
+    static const unsigned int BINS = 257;
+
+    std::vector<std::uint32_t> keys, sortedKeys, indices, sortedIndices;
+    // the digit counts of each chunk, then where the chunk writes the particles of each digit
+    std::vector<unsigned int> histograms;
+
+    // bin of the first pass: the low byte of the key, 256 for CULLED
+    static unsigned int lowDigit(std::uint32_t key) { return (key & 0xFF) | ((key >> 8) & 0x100); }
+
+    // turns the counts of the 256 digits of histograms into offsets, digit by digit and chunk by chunk; returns the
+    // total count
+    unsigned int prefixSum(unsigned int chunks)
+    {
+        unsigned int offset = 0;
+        for (unsigned int digit = 0; digit < 256; digit++)
+            for (unsigned int chunk = 0; chunk < chunks; chunk++)
+            {
+                unsigned int count = histograms[chunk * BINS + digit];
+                histograms[chunk * BINS + digit] = offset;
+                offset += count;
+            }
+        return offset;
+    }
+};
+
+// GPU sort: bitonic sort with transform feedback, as the particle update (see GpuParticles). A first pass writes
+// the key and index of every particle, padded to a power of two with keys that go last; then each pass of the
+// bitonic network reads the (key, index) pairs from buffer textures and writes, for every element, the smaller or
+// the larger of the element and of its partner to the other pair of buffers. n elements take
+// log2(n) * (log2(n) + 1) / 2 passes of n vertices, and the CPU only sets two uniforms per pass.
+// The indices end up in getIndexBuffer(), ready to be bound as the GL_ELEMENT_ARRAY_BUFFER of the particles.
+// The padded count must not exceed GL_MAX_TEXTURE_BUFFER_SIZE, see fits().
+class GpuParticleSort
+{
+public:
+    explicit GpuParticleSort(unsigned int count) : count(count)
+    {
+        while (size < count)
+            size <<= 1;
+        keyProgram = createProgram("shaders/particleSortKeys.vert");
+        bitonicProgram = createProgram("shaders/particleSortBitonic.vert");
+        eyeLocation = glGetUniformLocation(keyProgram, "eye");
+        forwardLocation = glGetUniformLocation(keyProgram, "forward");
+        rangeLocation = glGetUniformLocation(keyProgram, "range");
+        planesLocation = glGetUniformLocation(keyProgram, "planes");
+        blockSizeLocation = glGetUniformLocation(bitonicProgram, "blockSize");
+        distanceLocation = glGetUniformLocation(bitonicProgram, "compareDistance");
+        GLState::useProgram(bitonicProgram);
+        glUniform1i(glGetUniformLocation(bitonicProgram, "keys"), 0);
+        glUniform1i(glGetUniformLocation(bitonicProgram, "indices"), 1);
+
+        glGenBuffers(2, keyBuffers);
+        glGenBuffers(2, indexBuffers);
+        glGenTextures(2, keyTextures);
+        glGenTextures(2, indexTextures);
+        for (int i = 0; i < 2; i++)
+        {
+            createBufferTexture(keyBuffers[i], keyTextures[i]);
+            createBufferTexture(indexBuffers[i], indexTextures[i]);
+        }
+        // the keys and indices of the padding, copied after the keys of every sort
+        std::vector<std::uint32_t> padding(size - count, 0xFFFFFFFFu);
+        glGenBuffers(1, &paddingBuffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, paddingBuffer);
+        glBufferData(GL_COPY_READ_BUFFER, std::max<GLsizeiptr>(4, padding.size() * sizeof(std::uint32_t)), padding.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        glGenVertexArrays(1, &particleArray);
+        glGenVertexArrays(1, &emptyArray);
+    }
+
+    ~GpuParticleSort()
+    {
+        glDeleteVertexArrays(1, &particleArray);
+        glDeleteVertexArrays(1, &emptyArray);
+        glDeleteTextures(2, keyTextures);
+        glDeleteTextures(2, indexTextures);
+        glDeleteBuffers(2, keyBuffers);
+        glDeleteBuffers(2, indexBuffers);
+        glDeleteBuffers(1, &paddingBuffer);
+        glDeleteProgram(keyProgram);
+        glDeleteProgram(bitonicProgram);
+        GLState::invalidate();
+    }
+
+    // sorts the 'count' SimulatedParticle vertices of 'particleBuffer' as ParticleDepthSort::sort(), the particles
+    // outside of 'frustum' go last
+    void sort(GLuint particleBuffer, const Frustum &frustum, const glm::vec3 &eye, const glm::vec3 &forward, float range)
+    {
+        PROFILE_SCOPE("GpuParticleSort::sort");
+        glEnable(GL_RASTERIZER_DISCARD);
+
+        GLState::useProgram(keyProgram);
+        glUniform3fv(eyeLocation, 1, &eye[0]);
+        glUniform3fv(forwardLocation, 1, &forward[0]);
+        glUniform1f(rangeLocation, range);
+        glUniform4fv(planesLocation, 6, &frustum.planes[0][0]);
+        GLState::bindVertexArray(particleArray);
+        setupSimulatedParticleAttributes(particleBuffer, 0);
+        current = 0;
+        feedback(count);
+        if (size > count)
+        {
+            GLsizeiptr offset = count * sizeof(std::uint32_t), padding = (size - count) * sizeof(std::uint32_t);
+            glBindBuffer(GL_COPY_READ_BUFFER, paddingBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, keyBuffers[current]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, padding);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffers[current]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, padding);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        GLState::useProgram(bitonicProgram);
+        GLState::bindVertexArray(emptyArray);
+        for (unsigned int blockSize = 2; blockSize <= size; blockSize <<= 1)
+            for (unsigned int distance = blockSize >> 1; distance > 0; distance >>= 1)
+            {
+                GLState::bindTextureUnit(0, GL_TEXTURE_BUFFER, keyTextures[current]);
+                GLState::bindTextureUnit(1, GL_TEXTURE_BUFFER, indexTextures[current]);
+                glUniform1i(blockSizeLocation, (GLint) blockSize);
+                glUniform1i(distanceLocation, (GLint) distance);
+                current = 1 - current;
+                feedback(size);
+            }
+
+        glDisable(GL_RASTERIZER_DISCARD);
+    }
+
+    // whether the buffer textures of the sort can hold 'count' particles, padded to a power of two
+    static bool fits(unsigned int count)
+    {
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxSize);
+        unsigned int padded = 1;
+        while (padded < count)
+            padded <<= 1;
+        return padded <= (unsigned int) maxSize;
+    }
+
+    // the indices of the particles back to front (the first getCount() of them), then the ones outside of the
+    // frustum, after sort()
+    GLuint getIndexBuffer() const { return indexBuffers[current]; }
+    unsigned int getCount() const { return count; }
+    // passes of the bitonic network of a sort
+    unsigned int getPassCount() const
+    {
+        unsigned int log = 0;
+        while ((1u << log) < size)
+            log++;
+        return log * (log + 1) / 2;
+    }
+
+    GpuParticleSort(const GpuParticleSort&) = delete;
+    GpuParticleSort& operator=(const GpuParticleSort&) = delete;
+
+private:
+    unsigned int count, size = 1;
+    GLuint keyProgram = 0, bitonicProgram = 0;
+    GLuint keyBuffers[2] = {0, 0}, indexBuffers[2] = {0, 0};
+    GLuint keyTextures[2] = {0, 0}, indexTextures[2] = {0, 0};
+    GLuint paddingBuffer = 0;
+    GLuint particleArray = 0, emptyArray = 0;
+    // pair of buffers that holds the last keys and indices written
+    unsigned int current = 0;
+
+    GLint eyeLocation = -1, forwardLocation = -1, rangeLocation = -1, planesLocation = -1, blockSizeLocation = -1, distanceLocation = -1;
+
+    void createBufferTexture(GLuint buffer, GLuint texture)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, size * sizeof(std::uint32_t), nullptr, GL_DYNAMIC_COPY);
+        GLState::bindTextureUnit(0, GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // draws 'vertices' points with the program in use, the keys and indices go to the buffers of 'current'
+    void feedback(unsigned int vertices)
+    {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, keyBuffers[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, indexBuffers[current]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, vertices);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+    }
+
+    static GLuint createProgram(const char* vertexPath)
+    {
+        std::string vertexCode;
+        std::ifstream vShaderFile(vertexPath);
+        if (vShaderFile)
+        {
+            std::stringstream vShaderStream;
+            vShaderStream << vShaderFile.rdbuf();
+            vertexCode = vShaderStream.str();
+        }
+        else
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << vertexPath << std::endl;
+
+        // the keys and the indices go to buffers of their own, the indices are then a plain index buffer
+        const char* varyings[] = {"outKey", "outIndex"};
+        GLuint program = glCreateProgram();
+        std::string cacheKey = ProgramCache::makeKey({vertexCode}, "transform feedback: outKey | outIndex");
+        if (!ProgramCache::load(program, cacheKey))
+        {
+            const char* vShaderCode = vertexCode.c_str();
+            GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+            glShaderSource(vertex, 1, &vShaderCode, NULL);
+            glCompileShader(vertex);
+            GLint success;
+            char infoLog[1024];
+            glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(vertex, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: VERTEX\n" << infoLog << std::endl;
+            }
+            glAttachShader(program, vertex);
+            glTransformFeedbackVaryings(program, 2, varyings, GL_SEPARATE_ATTRIBS);
+            ProgramCache::prepare(program);
+            glLinkProgram(program);
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(program, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << std::endl;
+            }
+            else
+                ProgramCache::store(program, cacheKey);
+            glDeleteShader(vertex);
+        }
+        return program;
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_PARTICLE_SORT_H
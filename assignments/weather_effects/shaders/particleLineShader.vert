@@ -1,20 +1,31 @@
 #version 330 core
-layout (location = 0) in vec3 pos;
 out float lenColorScale;
 uniform mat4 model;
 uniform mat4 prevModel;
 uniform vec3 camPosition;
 uniform vec3 forwardOffset;
-uniform vec3 combinedOffset;
+// per layer data, 2 texels per layer (offset, velocity) from texel layerDataOffset on; the draw is of layer
+// layerBase + gl_InstanceID
+uniform samplerBuffer layerData;
+uniform int layerDataOffset;
+uniform int layerBase;
+// positions of the particles as fractions of the box and their rank in w, one texel per particle
+uniform samplerBuffer particles;
+// distance where the particles start to thin out, distance where they stop, density from there on
+uniform vec3 lodParameters;
 uniform float boxSize;
 uniform float heightScale;
-uniform vec3 g_vVelocity;
 
 
 // Simulate camera motion blur and camera exposure time by drawing the rain as lines
 void main()
 {
 
+    vec4 particle = texelFetch(particles, gl_VertexID / 2);
+    vec3 pos = particle.xyz * boxSize;
+    int layer = layerBase + gl_InstanceID;
+    vec3 combinedOffset = texelFetch(layerData, layerDataOffset + layer * 2).xyz;
+    vec3 g_vVelocity = texelFetch(layerData, layerDataOffset + layer * 2 + 1).xyz;
     vec3 newPos = mod(pos + combinedOffset, boxSize);
 
     newPos += camPosition + forwardOffset - boxSize/2;
@@ -40,4 +51,9 @@ void main()
     lenColorScale = clamp(len/lenPrev, 0.0, 1.0);
 
     gl_Position = finalPos;
+
+    // thin out with the distance: the particles of higher rank than the density are moved out of the clip volume
+    float density = mix(1.0, lodParameters.z, clamp((distance(newPos, camPosition) - lodParameters.x) / (lodParameters.y - lodParameters.x), 0.0, 1.0));
+    if (particle.w > density)
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
 }
\ No newline at end of file
@@ -1,16 +1,27 @@
 #version 330 core
-layout (location = 0) in vec3 pos;
 
 uniform mat4 model;
 uniform vec3 camPosition;
 uniform vec3 forwardOffset;
-uniform vec3 combinedOffset;
+// per layer data, 2 texels per layer (offset, velocity) from texel layerDataOffset on; the draw is of layer
+// layerBase + gl_InstanceID
+uniform samplerBuffer layerData;
+uniform int layerDataOffset;
+uniform int layerBase;
+// positions of the particles as fractions of the box and their rank in w, one texel per particle
+uniform samplerBuffer particles;
+// distance where the particles start to thin out, distance where they stop, density from there on
+uniform vec3 lodParameters;
 uniform float precipitationSize;
 uniform float boxSize;
 
 
 void main()
 {
+    vec4 particle = texelFetch(particles, gl_VertexID);
+    vec3 pos = particle.xyz * boxSize;
+    int layer = layerBase + gl_InstanceID;
+    vec3 combinedOffset = texelFetch(layerData, layerDataOffset + layer * 2).xyz;
     vec3 newPos = mod(pos + combinedOffset, boxSize);
     // Convert world space coordinates to screen space
     newPos += camPosition + forwardOffset - boxSize/2;
@@ -21,4 +32,9 @@ void main()
     // Make droplets close to the camera larger than those further away from the camera (distance equal to world space coords to camera position)
     float distanceToCamera = distance(newPos, camPosition);
     gl_PointSize = precipitationSize*20 - mix(precipitationSize, precipitationSize*6, distanceToCamera / 10);
+
+    // thin out with the distance: the particles of higher rank than the density are moved out of the clip volume
+    float density = mix(1.0, lodParameters.z, clamp((distanceToCamera - lodParameters.x) / (lodParameters.y - lodParameters.x), 0.0, 1.0));
+    if (particle.w > density)
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) in vec4 particlePosition; // xyz, age
+layout (location = 1) in vec4 particleVelocity; // xyz, lifetime
+out float lenColorScale;
+uniform mat4 model;
+uniform mat4 prevModel;
+uniform float streakTime;
+// seconds between the frame and the last simulation step, see particleSimulatedPoint.vert
+uniform float interpolationTime;
+
+
+// Simulate camera motion blur and camera exposure time by drawing the rain as lines,
+// one instance of two vertices per particle
+void main()
+{
+    vec4 worldPos = vec4(particlePosition.xyz - particleVelocity.xyz * min(interpolationTime, particlePosition.w), 1);
+    // where the particle was 'streakTime' seconds ago
+    vec4 worldPosPrev = vec4(worldPos.xyz - particleVelocity.xyz * streakTime, 1);
+
+    vec4 bottom = model * worldPos;
+
+    vec4 top = model * worldPosPrev;
+    vec4 topPrev = prevModel * worldPosPrev;
+
+    vec4 finalPos = mix(topPrev, bottom, gl_VertexID % 2);
+
+    vec2 dir = (top.xy/top.w) - (bottom.xy/bottom.w);
+    vec2 dirPrev = (topPrev.xy/topPrev.w) - (bottom.xy/bottom.w);
+
+    float len = length(dir);
+    float lenPrev = length(dirPrev);
+
+    lenColorScale = clamp(len/lenPrev, 0.0, 1.0);
+
+    gl_Position = finalPos;
+}
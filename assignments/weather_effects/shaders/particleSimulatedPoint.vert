@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec4 particlePosition; // xyz, age
+layout (location = 1) in vec4 particleVelocity; // xyz, lifetime
+
+uniform mat4 model;
+uniform vec3 camPosition;
+uniform float precipitationSize;
+// seconds between the frame and the last simulation step, the particle is drawn where it was that long before it
+uniform float interpolationTime;
+
+
+void main()
+{
+    // the simulation keeps the particles in world space, in the box around the camera
+    // a particle respawned by the last step was not anywhere before it
+    vec3 position = particlePosition.xyz - particleVelocity.xyz * min(interpolationTime, particlePosition.w);
+    gl_Position = model * vec4(position, 1.0);
+
+    // Make droplets close to the camera larger than those further away from the camera
+    float distanceToCamera = distance(position, camPosition);
+    gl_PointSize = precipitationSize*20 - mix(precipitationSize, precipitationSize*6, distanceToCamera / 10);
+}
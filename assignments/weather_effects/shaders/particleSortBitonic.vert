@@ -0,0 +1,27 @@
+#version 330 core
+// captured with transform feedback, to separate buffers
+flat out uint outKey;
+flat out uint outIndex;
+
+// the (key, index) pairs written by the previous pass
+uniform usamplerBuffer keys;
+uniform usamplerBuffer indices;
+uniform int blockSize;       // of the bitonic sequences being merged, a power of 2
+uniform int compareDistance; // to the partner of an element, a power of 2 below blockSize
+
+// one compare and swap of the bitonic network per element: the element keeps the smaller of itself and of its
+// partner if it is first in the pair in an increasing block, or last in the pair in a decreasing block
+void main()
+{
+    int i = gl_VertexID;
+    int partner = i ^ compareDistance;
+    uint key = texelFetch(keys, i).r, index = texelFetch(indices, i).r;
+    uint partnerKey = texelFetch(keys, partner).r, partnerIndex = texelFetch(indices, partner).r;
+
+    // the index breaks the ties, so the sort is stable
+    bool partnerLess = partnerKey < key || (partnerKey == key && partnerIndex < index);
+    bool keepSmaller = ((i & blockSize) == 0) == (i < partner);
+    bool takePartner = keepSmaller == partnerLess;
+    outKey = takePartner ? partnerKey : key;
+    outIndex = takePartner ? partnerIndex : index;
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec4 inPosition; // xyz, age
+// captured with transform feedback, to separate buffers
+flat out uint outKey;
+flat out uint outIndex;
+
+uniform vec3 eye;
+uniform vec3 forward;   // normalized
+uniform float range;    // depth of the last key
+uniform vec4 planes[6]; // of the view frustum, see Frustum
+
+// 16 bit depth key, back to front; the particles outside of the frustum get the key of the padding, and go last
+void main()
+{
+    bool inside = true;
+    for (int i = 0; i < 6; i++)
+        inside = inside && dot(planes[i].xyz, inPosition.xyz) + planes[i].w >= 0.0;
+    float depth = max(dot(inPosition.xyz - eye, forward), 0.0);
+    outKey = inside ? 65535u - uint(min(depth * 65535.0 / range, 65535.0)) : 0xFFFFFFFFu;
+    outIndex = uint(gl_VertexID);
+}
@@ -0,0 +1,71 @@
+#version 330 core
+layout (location = 0) in vec4 inPosition; // xyz, age
+layout (location = 1) in vec4 inVelocity; // xyz, lifetime
+// captured with transform feedback
+out vec4 outPosition;
+out vec4 outVelocity;
+
+uniform float deltaTime;
+uniform float time;
+uniform uint seed;      // different every update
+uniform vec3 boxCenter;
+uniform float boxSize;
+uniform vec3 wind;
+uniform float turbulence;
+uniform vec2 fallSpeed; // min, max
+uniform vec2 lifetime;  // min, max
+
+// PCG hash, a random sequence per particle and update
+uint pcgHash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random(inout uint state)
+{
+    state = pcgHash(state);
+    return float(state) / 4294967295.0;
+}
+
+// wind gusts, smooth in space and time
+vec3 gust(vec3 position)
+{
+    return vec3(sin(position.y * 0.37 + time * 1.3) + sin(position.z * 0.61 - time * 0.7),
+                0.25 * sin(position.x * 0.53 + time * 1.9),
+                cos(position.x * 0.41 - time * 1.1) + sin(position.y * 0.29 + time * 0.9)) * 0.5;
+}
+
+void main()
+{
+    vec3 position = inPosition.xyz;
+    float age = inPosition.w + deltaTime;
+    vec3 velocity = inVelocity.xyz;
+    float maxAge = inVelocity.w;
+    vec3 boxMin = boxCenter - boxSize * 0.5;
+
+    if (age >= maxAge)
+    {
+        // respawn anywhere in the box, falling at its own speed
+        uint state = pcgHash(uint(gl_VertexID) ^ pcgHash(seed));
+        position = boxMin + vec3(random(state), random(state), random(state)) * boxSize;
+        velocity = wind + vec3(0.0, -mix(fallSpeed.x, fallSpeed.y, random(state)), 0.0);
+        maxAge = mix(lifetime.x, lifetime.y, random(state));
+        age = 0.0;
+    }
+    else
+    {
+        // the horizontal velocity follows the wind and its gusts, the falling speed is already terminal
+        vec3 target = wind + gust(position) * turbulence;
+        velocity.xz = mix(velocity.xz, target.xz, clamp(deltaTime * 2.0, 0.0, 1.0));
+        velocity.y += target.y * deltaTime;
+        position += velocity * deltaTime;
+    }
+
+    // leave the box through one side, come back through the other
+    position = boxMin + mod(position - boxMin, boxSize);
+
+    outPosition = vec4(position, age);
+    outVelocity = vec4(velocity, maxAge);
+}
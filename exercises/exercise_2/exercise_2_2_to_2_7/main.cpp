@@ -2,14 +2,17 @@
 #include <GLFW/glfw3.h>
 
 #include <shader_s.h>
+#include <random.h>
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <chrono>
 
 void bindAttributes();
 void createVertexBufferObject();
 void emitParticle(float x, float y, float velocityX, float velocityY, float currentTime);
+void flushParticles();
 // glfw functions
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -30,6 +33,10 @@ const unsigned int particleSize = 5;            // particle attributes
 const unsigned int sizeOfFloat = 4;             // bytes in a float
 unsigned int particleId = 0;                    // keep track of last particle to be updated
 Shader *shaderProgram;                          // our shader program
+Random randomStream(1);                         // randomness of the emitted particles
+std::vector<float> pendingParticles;            // particles emitted this frame, not uploaded yet
+bool burstMode = false;                         // B toggles bursts of burstParticles particles per frame
+const unsigned int burstParticles = 2000;
 
 int main()
 {
@@ -111,7 +118,8 @@ int main()
         glUniform1f(vertexOffsetLocation, currentTime);
 
 
-        // render particles
+        // upload the particles emitted this frame, and render particles
+        flushParticles();
         glBindVertexArray(VAO);
         glDrawArrays(GL_POINTS, 0, vertexBufferSize);
 
@@ -176,8 +184,6 @@ void createVertexBufferObject(){
 }
 
 void emitParticle(float x, float y, float velocityX, float velocityY, float timeOfBirth){
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     float data[particleSize];
     data[0] = x;
     data[1] = y;
@@ -187,9 +193,28 @@ void emitParticle(float x, float y, float velocityX, float velocityY, float time
 
     // TODO 2.2 , add velocity and timeOfBirth to the particle data
 
-    // upload only parts of the buffer
-    glBufferSubData(GL_ARRAY_BUFFER, particleId * particleSize * sizeOfFloat, particleSize * sizeOfFloat, data);
-    particleId = (particleId + 1) % vertexBufferSize;
+    // stage the particle, flushParticles() uploads all the particles of the frame together
+    pendingParticles.insert(pendingParticles.end(), data, data + particleSize);
+}
+
+void flushParticles(){
+    unsigned int count = pendingParticles.size() / particleSize;
+    if (count == 0)
+        return;
+    // the ring holds vertexBufferSize particles, the older ones of a larger batch would be overwritten anyway
+    unsigned int skipped = count > vertexBufferSize ? count - vertexBufferSize : 0;
+    const float* data = &pendingParticles[skipped * particleSize];
+    particleId = (particleId + skipped) % vertexBufferSize;
+    count -= skipped;
+
+    // upload only parts of the buffer: one range, or two if the particles wrap around the end of the ring
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    unsigned int untilEnd = std::min(count, vertexBufferSize - particleId);
+    glBufferSubData(GL_ARRAY_BUFFER, particleId * particleSize * sizeOfFloat, untilEnd * particleSize * sizeOfFloat, data);
+    if (count > untilEnd)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (count - untilEnd) * particleSize * sizeOfFloat, data + untilEnd * particleSize);
+    particleId = (particleId + count) % vertexBufferSize;
+    pendingParticles.clear();
 }
 
 
@@ -200,6 +225,13 @@ void processInput(GLFWwindow *window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // toggle the burst mode when B goes down
+    static bool burstKeyWasDown = false;
+    bool burstKeyDown = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+    if (burstKeyDown && !burstKeyWasDown)
+        burstMode = !burstMode;
+    burstKeyWasDown = burstKeyDown;
+
     // get screen size and click coordinates
     double xPos, yPos;
     int xScreen, yScreen;
@@ -215,15 +247,16 @@ void processInput(GLFWwindow *window)
         // compute velocity based on two consecutive updates
         float velocityX = xNdc - lastX;
         float velocityY = yNdc - lastY;
-        float max_rand = (float) (RAND_MAX);
-        // create 5 to 10 particles per frame
-        int i = (int) ((float) (rand()) / max_rand) * 5;
-        for (; i < 10; i++) {
+        // create 5 to 10 particles per frame, or a burst of burstParticles spread over a wider area
+        int i = burstMode ? 0 : (int) randomStream.below(6);
+        int particles = burstMode ? burstParticles : 10;
+        float spread = burstMode ? .25f : .05f;
+        for (; i < particles; i++) {
             // add some randomness to the movement parameters
-            float offsetX = ((float) (rand()) / max_rand - .5f) * .1f;
-            float offsetY = ((float) (rand()) / max_rand - .5f) * .1f;
-            float offsetVelX = ((float) (rand()) / max_rand - .5f) * .1f;
-            float offsetVelY = ((float) (rand()) / max_rand - .5f) * .1f;
+            float offsetX = randomStream.between(-spread, spread);
+            float offsetY = randomStream.between(-spread, spread);
+            float offsetVelX = randomStream.between(-.05f, .05f);
+            float offsetVelY = randomStream.between(-.05f, .05f);
             // create the particle
             emitParticle(xNdc + offsetX, yNdc + offsetY, velocityX + offsetVelX, velocityY + offsetVelY, currentTime);
         }
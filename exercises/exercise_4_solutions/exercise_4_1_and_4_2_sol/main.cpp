@@ -25,6 +25,12 @@ struct SceneObject{
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, vertexCount, GL_UNSIGNED_INT, 0);
     }
+
+    // draws 'instanceCount' copies in one draw call, needs an instance buffer (see createInstanceBuffer)
+    void drawSceneObjectInstanced(unsigned int instanceCount){
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, vertexCount, GL_UNSIGNED_INT, 0, instanceCount);
+    }
 };
 
 // function declarations
@@ -32,6 +38,7 @@ struct SceneObject{
 unsigned int createArrayBuffer(const std::vector<float> &array);
 unsigned int createElementArrayBuffer(const std::vector<unsigned int> &array);
 unsigned int createVertexArray(const std::vector<float> &positions, const std::vector<float> &colors, const std::vector<unsigned int> &indices);
+unsigned int createInstanceBuffer(unsigned int VAO, unsigned int maxInstances);
 void setup();
 void drawArrow();
 void drawPlane();
@@ -58,6 +65,8 @@ SceneObject planeBody;
 SceneObject planeWing;
 SceneObject planePropeller;
 Shader* shaderProgram;
+Shader* instancedShaderProgram;
+unsigned int planeWingInstanceVBO;
 
 // global variables used for control
 // -----------------------------------
@@ -157,6 +166,7 @@ int main()
     }
 
     delete shaderProgram;
+    delete instancedShaderProgram;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -267,10 +277,9 @@ void drawPlane(){
     // 10 times smaller -> leaning toward the turn direction -> plane rotation -> plane position
     glm::mat4 model = translation * rotation * scale;
 
-    // draw plane body and right wing
+    // draw plane body
     shaderProgram->setMat4("model", model);
     planeBody.drawSceneObject();
-    planeWing.drawSceneObject();
 
     // propeller,
     // half size -> make perpendicular to plane forward axis -> rotate around plane forward axis -> move to the tip of the plane
@@ -282,23 +291,26 @@ void drawPlane(){
     shaderProgram->setMat4("model", propeller);
     planePropeller.drawSceneObject();
 
+    // the four wings share the same mesh, so we draw them with a single instanced draw call
+    glm::mat4 wings[4];
+    // right wing
+    wings[0] = model;
     // right wing back,
     // half size -> move to the back
-    glm::mat4 wingRightBack = model * glm::translate(0.0f, -0.5f, 0.0f) * glm::scale(.5f,.5f,.5f);
-    shaderProgram->setMat4("model", wingRightBack);
-    planeWing.drawSceneObject();
-
+    wings[1] = model * glm::translate(0.0f, -0.5f, 0.0f) * glm::scale(.5f,.5f,.5f);
     // left wing,
     // mirror in x
-    glm::mat4 wingLeft = model * glm::scale(-1.0f, 1.0f, 1.0f);
-    shaderProgram->setMat4("model", wingLeft);
-    planeWing.drawSceneObject();
-
+    wings[2] = model * glm::scale(-1.0f, 1.0f, 1.0f);
     // left wing back,
     // half size + mirror in x -> move to the back
-    glm::mat4 wingLeftBack =  model *  glm::translate(0.0f, -0.5f, 0.0f) * glm::scale(-.5f,.5f,.5f);
-    shaderProgram->setMat4("model", wingLeftBack);
-    planeWing.drawSceneObject();
+    wings[3] = model * glm::translate(0.0f, -0.5f, 0.0f) * glm::scale(-.5f,.5f,.5f);
+
+    glBindBuffer(GL_ARRAY_BUFFER, planeWingInstanceVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(wings), &wings[0]);
+
+    instancedShaderProgram->use();
+    planeWing.drawSceneObjectInstanced(4);
+    shaderProgram->use();
 
 }
 
@@ -306,6 +318,7 @@ void drawPlane(){
 void setup(){
     // initialize shaders
     shaderProgram = new Shader("shaders/objectShader.vert", "shaders/objectShader.frag");
+    instancedShaderProgram = new Shader("shaders/shader_instanced.vert", "shaders/shader.frag");
 
     PlaneModel& airplane = PlaneModel::getInstance();
     // initialize plane body mesh objects
@@ -319,6 +332,8 @@ void setup(){
                                       airplane.planeWingColors,
                                       airplane.planeWingIndices);
     planeWing.vertexCount = airplane.planeWingIndices.size();
+    // per-instance model matrices of the four wings
+    planeWingInstanceVBO = createInstanceBuffer(planeWing.VAO, 4);
 
     // initialize plane wing mesh objects
     planePropeller.VAO = createVertexArray(airplane.planePropellerVertices,
@@ -359,6 +374,27 @@ unsigned int createVertexArray(const std::vector<float> &positions, const std::v
     return VAO;
 }
 
+unsigned int createInstanceBuffer(unsigned int VAO, unsigned int maxInstances){
+    glBindVertexArray(VAO);
+
+    unsigned int VBO;
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, maxInstances * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+
+    // set vertex shader attribute "instanceModel",
+    // a mat4 attribute takes four locations (one per column) and advances once per instance
+    int modelAttributeLocation = glGetAttribLocation(instancedShaderProgram->ID, "instanceModel");
+    for (int i = 0; i < 4; i++){
+        glEnableVertexAttribArray(modelAttributeLocation + i);
+        glVertexAttribPointer(modelAttributeLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(modelAttributeLocation + i, 1);
+    }
+
+    glBindVertexArray(0);
+    return VBO;
+}
+
 unsigned int createArrayBuffer(const std::vector<float> &array){
     unsigned int VBO;
     glGenBuffers(1, &VBO);
@@ -1,9 +1,10 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <texture_uploader.h>
+#include <frame_pacer.h>
 #include <iostream>
 
 #include <vector>
-#include <chrono>
 
 #include "srl_point_renderer.h"
 #include "srl_line_renderer.h"
@@ -120,6 +121,8 @@ int main()
     // set texture filtering parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // allocate the texture storage once, every frame the image is streamed to it through a pixel buffer object
+    TextureUploader* bufferUploader = new TextureUploader(bufferTexture, max_W, max_H);
 
     // initialize openGL frame buffer object
     // ------------------------------------
@@ -129,9 +132,9 @@ int main()
 
     // render loop
     // -----------
-    // render every loopInterval seconds
-    float loopInterval = 1.f/60.f;
-    auto begin = std::chrono::high_resolution_clock::now();
+    // render every 1/60 seconds, the pacer sleeps between the frames
+    FramePacer framePacer(1.f/60.f);
+    glfwSwapInterval(framePacer.swapInterval());
 
     std::cout << "Key mapping:" << std::endl;
     std::cout << "1 - use point renderer" << std::endl;
@@ -140,9 +143,8 @@ int main()
 
     while (!glfwWindowShouldClose(window))
     {
-        // update current time
-        auto frameStart = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<float> appTime = frameStart - begin;
+        // start timing the frame
+        framePacer.beginFrame();
 
 
         // render to our custom frame buffer
@@ -155,9 +157,7 @@ int main()
         // show our rendered image
         // -----------------------
         // upload the custom color buffer to the GPU using the texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bufferTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, max_W, max_H, 0, GL_RGBA, GL_UNSIGNED_BYTE, customBuffer.buffer);
+        bufferUploader->upload(customBuffer.buffer);
 
         // set opengl frame buffer object to read from our texture, we will copy from it
         glBindFramebuffer(GL_READ_FRAMEBUFFER, oglFrameBuffer);
@@ -175,13 +175,13 @@ int main()
         glfwSwapBuffers(window);
         glfwPollEvents();
 
-        // control render loop frequency (busy wait)
-        std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now()-frameStart;
-        while (loopInterval > elapsed.count()) {
-            elapsed = std::chrono::high_resolution_clock::now() - frameStart;
-        }
+        // control render loop frequency
+        framePacer.endFrame();
     }
 
+    // release the pixel buffers while the context is still alive
+    delete bufferUploader;
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -10,6 +10,8 @@
 #include "glm/glm.hpp"
 #include "srl_types.h"
 
+#include <job_system.h>
+
 
 namespace srl {
     class Renderer {
@@ -65,11 +67,14 @@ namespace srl {
         virtual void rasterPrimitives(std::vector<fragment> &outFrs) = 0;
 
         // perform vertex operations in the vertex stream (i.e. the equivalent to a vertex shader)
+        // the vertices are independent, so large meshes are split between the threads of the job system
         static void processVertices(const glm::mat4 &mvp, std::vector<vertex> &vInOut) {
-            for (auto &vtx : vInOut){
-                // this is the equivalent to a vertex shader
-                vtx.pos = mvp * vtx.pos;
-            }
+            JobSystem::instance().parallelFor(0, (unsigned int) vInOut.size(), 4096, [&](unsigned int begin, unsigned int end){
+                for (unsigned int i = begin; i < end; i++){
+                    // this is the equivalent to a vertex shader
+                    vInOut[i].pos = mvp * vInOut[i].pos;
+                }
+            });
         }
 
         // perform fragment operations in the fragment stream (i.e. fragment shader)
@@ -83,14 +88,24 @@ namespace srl {
 
         // fragment operations and copy color to frame buffer
         // blending test and z/depth-buffer can come here
+        // each thread of the job system owns a band of rows and goes through all the fragments in order, so the
+        // fragments of a pixel are depth tested in the same order as on a single thread
         static void writeToFrameBuffer(const std::vector<fragment> &frs, CustomFrameBuffer <uint32_t> &fb, CustomFrameBuffer <float> &db) {
+            unsigned int bands = JobSystem::instance().threadCount();
+            JobSystem::instance().parallelFor(0, bands, 1, [&](unsigned int bandBegin, unsigned int bandEnd){
+                writeRows(frs, fb, db, (int) (fb.H * bandBegin / bands), (int) (fb.H * bandEnd / bands));
+            });
+        }
+
+        // writeToFrameBuffer for the fragments in the rows [rowBegin, rowEnd)
+        static void writeRows(const std::vector<fragment> &frs, CustomFrameBuffer <uint32_t> &fb, CustomFrameBuffer <float> &db,
+                              int rowBegin, int rowEnd) {
 			int width = fb.W;
-			int height = fb.H;
             for (int i = 0, size = frs.size(); i < size; i++) {
                 glm::ivec2 pos = frs[i].pos;
 
                 // make sure it is within framebuffer range (it won't be if we do not clip)
-				if (pos.x < 0 || pos.x >= width || pos.y < 0 || pos.y >= height)
+				if (pos.x < 0 || pos.x >= width || pos.y < rowBegin || pos.y >= rowEnd)
 					continue;
 
 				// z/depth-test algorithm:
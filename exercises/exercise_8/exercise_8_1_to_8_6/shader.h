@@ -10,6 +10,8 @@
 #include <sstream>
 #include <iostream>
 
+#include <program_cache.h>
+
 class Shader
 {
 public:
@@ -60,7 +62,12 @@ public:
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 2. reuse the program binary of a previous run if neither the sources nor the driver changed
+        ID = glCreateProgram();
+        std::string cacheKey = ProgramCache::makeKey({vertexCode, fragmentCode, geometryCode});
+        if (ProgramCache::load(ID, cacheKey))
+            return;
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -83,13 +90,14 @@ public:
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        ProgramCache::prepare(ID);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        ProgramCache::store(ID, cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
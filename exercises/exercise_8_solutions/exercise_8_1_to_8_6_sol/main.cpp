@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 
+#include <cstdlib>
 #include <vector>
 
 // NEW! as our scene gets more complex, we start using more helper classes
@@ -11,13 +12,25 @@
 #include "camera.h"
 #include "model.h"
 
+#include <uniform_buffer.h>
+#include <frame_uniforms.h>
+#include <gpu_timer.h>
+#include <light_clusters.h>
+#include <shader_preprocessor.h>
+#include <gl_state.h>
+#include <random.h>
+
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
 // function declarations
 // ---------------------
-void drawObjects();
+void updateFrameUniforms();
+Shader* selectShader();
+void generatePointLights();
+void updateLightClusters();
+void drawObjects(Shader* shader);
 void drawGui();
 
 // glfw and input functions
@@ -35,12 +48,19 @@ const unsigned int SCR_HEIGHT = 720;
 
 // global variables used for rendering
 // -----------------------------------
-Shader* shader;
-Shader* gouraud_shading;
-Shader* phong_shading;
+Shader* shader; // permutation of the selected shading model, see selectShader()
+ShaderVariants<Shader>* gouraud_shading;
+ShaderVariants<Shader>* phong_shading;
+Shader* depthShader;
+GpuTimer* shadingTimer;
+GpuTimer* depthPrepassTimer;
 Model* carModel;
 Model* carWheel;
 Model* floorModel;
+UniformBuffer* frameUniformBuffer;
+LightClusters* lightClusters;
+std::vector<PointLight> pointLights; // the generated lights, see generatePointLights()
+std::vector<PointLight> frameLights; // the lights shaded this frame
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
 
 // global variables used for control
@@ -53,12 +73,17 @@ bool isPaused = false; // stop camera movement when GUI is open
 
 // structure to hold lighting info
 // -------------------------------
+enum ShadingModel {GOURAUD_SHADING, PHONG_SHADING, CLUSTERED_PHONG_SHADING};
+
 struct Config {
 
     // ambient light
     glm::vec3 ambientLightColor = {1.0f, 1.0f, 1.0f};
     float ambientLightIntensity = 0.2f;
 
+    // number of lights in use, 1 and 2
+    int lightCount = 2;
+
     // light 1
     glm::vec3 light1Position = {-0.8f, 2.4f, 0.0f};
     glm::vec3 light1Color = {1.0f, 1.0f, 1.0f};
@@ -81,6 +106,16 @@ struct Config {
     float attenuationC1 = 0.1;
     float attenuationC2 = 0.1;
 
+    ShadingModel shadingModel = PHONG_SHADING;
+
+    // depth pre-pass, so that the lighting is computed only once per pixel
+    bool depthPrepass = false;
+
+    // generated point lights, shaded with clustered phong shading (lights 1 and 2 are shaded as well)
+    int pointLightCount = 200;
+    float pointLightRadius = 1.5f;
+    float pointLightIntensity = 0.6f;
+
 } config;
 
 
@@ -125,9 +160,22 @@ int main()
 
     // load the shaders and the 3D models
     // ----------------------------------
-    gouraud_shading = new Shader("shaders/gouraud_shading.vert", "shaders/gouraud_shading.frag");
-    phong_shading = new Shader("shaders/phong_shading.vert", "shaders/phong_shading.frag");
-    shader = phong_shading;//gouraud_shading;
+    // the shading programs are specialized for the number of lights and the clustered lights,
+    // each permutation is compiled the first time it is selected
+    auto bindFrameUniforms = [](Shader &permutation){
+        permutation.setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    };
+    gouraud_shading = new ShaderVariants<Shader>("shaders/gouraud_shading.vert", "shaders/gouraud_shading.frag");
+    gouraud_shading->onCreate = bindFrameUniforms;
+    phong_shading = new ShaderVariants<Shader>("shaders/phong_shading.vert", "shaders/phong_shading.frag");
+    phong_shading->onCreate = bindFrameUniforms;
+    depthShader = new Shader("shaders/depth_only.vert", "shaders/depth_only.frag");
+    depthShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    shadingTimer = new GpuTimer();
+    depthPrepassTimer = new GpuTimer();
+    frameUniformBuffer = new UniformBuffer(sizeof(FrameUniforms), FRAME_UNIFORMS_BINDING);
+    lightClusters = new LightClusters();
+    generatePointLights();
     carModel = new Model(std::vector<string>{"car/Body_LOD0.obj", "car/Interior_LOD0.obj", "car/Paint_LOD0.obj", "car/Light_LOD0.obj", "car/Windows_LOD0.obj"});
     carWheel = new Model("car/Wheel_LOD0.obj");
     floorModel = new Model("floor/floor.obj");
@@ -158,17 +206,50 @@ int main()
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        GLState::newFrame();
 
         processInput(window);
 
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        shader = selectShader();
+        updateFrameUniforms();
+        if (config.shadingModel == CLUSTERED_PHONG_SHADING)
+            updateLightClusters();
+
+        if (config.depthPrepass) {
+            // depth-only pass, it fills the depth buffer with the closest surfaces
+            depthPrepassTimer->begin();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            depthShader->use();
+            // the material uniforms don't exist in the depth program, setting them has no effect
+            drawObjects(depthShader);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            depthPrepassTimer->end();
+
+            // only the closest fragment of each pixel passes, so each pixel is shaded once
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        shadingTimer->begin();
         shader->use();
-        drawObjects();
+        if (config.shadingModel == CLUSTERED_PHONG_SHADING) {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            lightClusters->bind(shader->ID, viewport[2], viewport[3]);
+        }
+        drawObjects(shader);
+        shadingTimer->end();
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
 
         if (isPaused) {
             drawGui();
+            // ImGui binds its own program, VAO and texture
+            GLState::invalidate();
         }
 
         glfwSwapBuffers(window);
@@ -186,6 +267,11 @@ int main()
     delete carWheel;
     delete gouraud_shading;
     delete phong_shading;
+    delete lightClusters;
+    delete depthShader;
+    delete shadingTimer;
+    delete depthPrepassTimer;
+    delete frameUniformBuffer;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -212,6 +298,9 @@ void drawGui(){
         ImGui::SliderFloat("ambient light intensity", &config.ambientLightIntensity, 0.0f, 1.0f);
         ImGui::Separator();
 
+        ImGui::SliderInt("lights in use", &config.lightCount, 0, 2);
+        ImGui::Separator();
+
         ImGui::Text("Light 1: ");
         ImGui::DragFloat3("light 1 position", (float*)&config.light1Position, .1, -20, 20);
         ImGui::ColorEdit3("light 1 color", (float*)&config.light1Color);
@@ -240,9 +329,35 @@ void drawGui(){
 
         ImGui::Text("Shading model: ");
         {
-            if (ImGui::RadioButton("Gouraud Shading", shader == gouraud_shading)) { shader = gouraud_shading; }
-            if (ImGui::RadioButton("Phong Shading", shader == phong_shading)) { shader = phong_shading; }
+            if (ImGui::RadioButton("Gouraud Shading", config.shadingModel == GOURAUD_SHADING)) { config.shadingModel = GOURAUD_SHADING; }
+            if (ImGui::RadioButton("Phong Shading", config.shadingModel == PHONG_SHADING)) { config.shadingModel = PHONG_SHADING; }
+            if (ImGui::RadioButton("Clustered Phong Shading", config.shadingModel == CLUSTERED_PHONG_SHADING)) { config.shadingModel = CLUSTERED_PHONG_SHADING; }
         }
+        ImGui::Text("%u shader permutations compiled", (unsigned int) (gouraud_shading->size() + phong_shading->size()));
+        ImGui::Separator();
+
+        if (config.shadingModel == CLUSTERED_PHONG_SHADING) {
+            static float assignMs = 0.0f;
+            ImGui::SliderInt("point lights", &config.pointLightCount, 0, (int) pointLights.size());
+            ImGui::SliderFloat("point light radius", &config.pointLightRadius, 0.1f, 5.0f);
+            ImGui::SliderFloat("point light intensity", &config.pointLightIntensity, 0.0f, 1.0f);
+            assignMs = assignMs * 0.95f + lightClusters->lastAssignMs * 0.05f;
+            ImGui::Text("%u light indices in %u clusters, assigned in %.3f ms on %u threads",
+                        lightClusters->totalLightIndices(), LightClusters::CLUSTER_COUNT, assignMs,
+                        JobSystem::instance().threadCount());
+            ImGui::Separator();
+        }
+
+        // the shading cost is measured with and without the depth pre-pass, switch it on and off to compare
+        static float shadingMs[2] = {0.0f, 0.0f}, depthPrepassMs = 0.0f;
+        shadingMs[config.depthPrepass] = shadingTimer->averageMs;
+        if (config.depthPrepass)
+            depthPrepassMs = depthPrepassTimer->averageMs;
+        if (ImGui::Checkbox("depth pre-pass", &config.depthPrepass))
+            shadingTimer->reset();
+        ImGui::Text("Shading: %.3f ms without pre-pass, %.3f ms with pre-pass (+ %.3f ms depth only)",
+                    shadingMs[0], shadingMs[1], depthPrepassMs);
+        ImGui::Text("GL state: %u binds issued, %u elided", GLState::lastFrame().issued, GLState::lastFrame().elided);
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
         ImGui::End();
     }
@@ -253,18 +368,80 @@ void drawGui(){
 
 
 
-void drawObjects(){
+// camera, light and attenuation parameters are the same for every program and object in a frame,
+// so we upload them once per frame to a uniform buffer that all programs read from
+void updateFrameUniforms(){
+    FrameUniforms frame;
 
-    // camera position
-    shader->setVec3("camPosition", camera.Position);
+    // camera parameters
+    frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    frame.view = camera.GetViewMatrix();
+    frame.camPosition = glm::vec4(camera.Position, 1.0f);
+
+    // light parameters
+    frame.ambientLightColor = glm::vec4(config.ambientLightColor * config.ambientLightIntensity, 1.0f);
+    frame.lightPositions[0] = glm::vec4(config.light1Position, 1.0f);
+    frame.lightColors[0] = glm::vec4(config.light1Color * config.light1Intensity, 1.0f);
+    frame.lightPositions[1] = glm::vec4(config.light2Position, 1.0f);
+    frame.lightColors[1] = glm::vec4(config.light2Color * config.light2Intensity, 1.0f);
+
+    // attenuation, and number of lights in use
+    frame.lightAttenuation = glm::vec4(config.attenuationC0, config.attenuationC1, config.attenuationC2, (float) config.lightCount);
+
+    frameUniformBuffer->update(frame);
+}
 
-    // TODO exercise 8 - set the missing uniform variables here
-    // light uniforms
-    shader->setVec3("ambientLightColor", config.ambientLightColor * config.ambientLightIntensity);
-    shader->setVec3("light1Position", config.light1Position);
-    shader->setVec3("light1Color", config.light1Color * config.light1Intensity);
-    shader->setVec3("light2Position", config.light2Position);
-    shader->setVec3("light2Color", config.light2Color * config.light2Intensity);
+
+// a night scene of street lights and small colored lights scattered around the car,
+// the colors and positions are generated once, their radius and intensity are set in the gui
+void generatePointLights(){
+    const unsigned int maxPointLights = 1000;
+    const glm::vec3 colors[] = {{1.0f, 0.8f, 0.5f}, {1.0f, 0.6f, 0.3f}, {0.6f, 0.7f, 1.0f}, {1.0f, 0.3f, 0.3f}, {0.4f, 1.0f, 0.5f}};
+    // the same seed gives the same lights on every run and platform
+    Random lightStream(1);
+    pointLights.resize(maxPointLights);
+    for (PointLight &light : pointLights) {
+        float x = lightStream.between(-10.0f, 10.0f);
+        float z = lightStream.between(-10.0f, 10.0f);
+        float y = lightStream.between(0.1f, 1.6f);
+        light.position = glm::vec3(x, y, z);
+        light.color = colors[lightStream.below(sizeof(colors) / sizeof(colors[0]))];
+    }
+}
+
+
+// program of the selected shading model, specialized for the current settings
+Shader* selectShader(){
+    ShaderDefines defines;
+    // the shader loops over a constant number of lights, and the lights that are not in use cost nothing
+    defines.set("LIGHT_COUNT", config.lightCount);
+    if (config.shadingModel == CLUSTERED_PHONG_SHADING)
+        defines.set("CLUSTERED_LIGHTS");
+    ShaderVariants<Shader>* variants = config.shadingModel == GOURAUD_SHADING ? gouraud_shading : phong_shading;
+    return &variants->get(defines);
+}
+
+
+// the generated lights are short range, lights 1 and 2 are shaded from the FrameUniforms block
+void updateLightClusters(){
+    frameLights.clear();
+    for (int i = 0; i < config.pointLightCount; i++) {
+        PointLight light = pointLights[i];
+        light.color *= config.pointLightIntensity;
+        light.radius = config.pointLightRadius;
+        frameLights.push_back(light);
+    }
+
+    // same camera as in updateFrameUniforms()
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::vec3 attenuation(config.attenuationC0, config.attenuationC1, config.attenuationC2);
+    lightClusters->update(frameLights, attenuation, camera.GetViewMatrix(), projection, 0.1f, 100.0f);
+}
+
+
+void drawObjects(Shader* shader){
+
+    // camera, light and attenuation uniforms are set once per frame in updateFrameUniforms()
 
     // material uniforms
     shader->setVec3("reflectionColor", config.reflectionColor);
@@ -273,28 +450,14 @@ void drawObjects(){
     shader->setFloat("specularReflectance", config.specularReflectance);
     shader->setFloat("specularExponent", config.specularExponent);
 
-    // attenuation uniforms
-    shader->setFloat("attenuationC0", config.attenuationC0);
-    shader->setFloat("attenuationC1", config.attenuationC1);
-    shader->setFloat("attenuationC2", config.attenuationC2);
-
 
     // the typical transformation uniforms are already set for you, these are:
-    // projection (perspective projection matrix)
-    // view (to map world space coordinates to the camera space, so the camera position becomes the origin)
+    // projection (perspective projection matrix, in the FrameUniforms block)
+    // view (to map world space coordinates to the camera space, so the camera position becomes the origin, in the FrameUniforms block)
     // model (for each model part we draw)
     // invTransposeModel (inverse of the transpose of the model matrix, it ensures that the angle between the normal and
     //                 the surface will be preserved after transformation)
 
-    // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
-
-    // set projection and view matrix uniforms
-    shader->setMat4("projection", projection);
-    shader->setMat4("view", view);
-
     // NEW! we use the Model class to load the geometry and dispatch the render commands to OpenGL
     // draw car
     glm::mat4 model = glm::mat4(1.0f);
@@ -8,6 +8,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include <gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -47,12 +48,9 @@ public:
     // render the mesh
     void Draw()
     {
-        glBindVertexArray(VAO);
+        // the VAO stays bound so that the next draw of the same mesh does not bind it again
+        GLState::bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
@@ -68,7 +66,7 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -90,7 +88,8 @@ private:
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
 
-        glBindVertexArray(0);
+        // unbound, so that later element buffer binds can't change the VAO
+        GLState::bindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
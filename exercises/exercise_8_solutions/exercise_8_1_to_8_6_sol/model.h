@@ -11,6 +11,8 @@
 //  objloader is used to parse those files
 #include "objloader.h"
 
+#include <job_system.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -34,10 +36,17 @@ public:
         loadModel(path);
     }
 
+    // the files are parsed in parallel on the job system, the meshes (and their GL buffers) are then created
+    // on this thread, in the order of 'paths'
     Model(std::vector<string> const &paths)
     {
-        for(auto path : paths)
-            loadModel(path);
+        std::vector<ObjData> objs(paths.size());
+        JobSystem::instance().parallelFor(0, (unsigned int) paths.size(), 1, [&](unsigned int begin, unsigned int end){
+            for (unsigned int i = begin; i < end; i++)
+                loadOBJ(paths[i].c_str(), objs[i].vertices, objs[i].uvs, objs[i].normals);
+        });
+        for (const ObjData &obj : objs)
+            meshes.push_back(processMesh(obj.vertices, obj.uvs, obj.normals));
     }
 
     // draws the model, and thus all its meshes
@@ -48,6 +57,13 @@ public:
     }
 
 private:
+    // the content of an OBJ file, parsed on a worker thread
+    struct ObjData {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+    };
+
     /*  Functions   */
     // loads a model
     void loadModel(string const &path)
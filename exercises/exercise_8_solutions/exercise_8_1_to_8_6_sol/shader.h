@@ -10,57 +10,35 @@
 #include <sstream>
 #include <iostream>
 
+#include <program_cache.h>
+#include <shader_preprocessor.h>
+#include <gl_state.h>
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, the sources can #include other files and are specialized
+    // with 'defines' (see shader_preprocessor.h)
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const ShaderDefines &defines = ShaderDefines())
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
+        // 1. retrieve the vertex/fragment source code from filePath, with the includes resolved
+        std::string vertexCode = ShaderPreprocessor::load(vertexPath, defines);
+        std::string fragmentCode = ShaderPreprocessor::load(fragmentPath, defines);
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if (geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
+        // if geometry shader path is present, also load a geometry shader
+        if (geometryPath != nullptr)
+            geometryCode = ShaderPreprocessor::load(geometryPath, defines);
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 2. reuse the program binary of a previous run if neither the sources nor the driver changed
+        ID = glCreateProgram();
+        std::string cacheKey = ProgramCache::makeKey({vertexCode, fragmentCode, geometryCode}, defines.toString());
+        if (ProgramCache::load(ID, cacheKey))
+            return;
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -83,13 +61,14 @@ public:
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        ProgramCache::prepare(ID);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        ProgramCache::store(ID, cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -101,7 +80,7 @@ public:
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        GLState::useProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -161,6 +140,14 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    // ------------------------------------------------------------------------
+    // map the uniform block 'name' (declared with the std140 layout) to a uniform buffer binding point
+    void setUniformBlockBinding(const std::string &name, unsigned int binding) const
+    {
+        unsigned int blockIndex = glGetUniformBlockIndex(ID, name.c_str());
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, blockIndex, binding);
+    }
 
 private:
     // utility function for checking shader compilation/linking errors.
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 vertex;
+
+uniform mat4 model; // represents model coordinates in the world coord space
+
+#include "frame_uniforms.glsl"
+
+// the depth of the pre-pass must match the depth of the shaded pass exactly (it is tested with GL_EQUAL),
+// so gl_Position is invariant and computed with the same expression as in the shading programs
+invariant gl_Position;
+
+void main() {
+   vec4 P = model * vec4(vertex, 1.0);
+   gl_Position = projection * view * P;
+}
@@ -0,0 +1,10 @@
+// per-frame camera and lighting state, uploaded once per frame (see frame_uniforms.h)
+layout (std140) uniform FrameUniforms {
+   mat4 projection; // camera projection matrix
+   mat4 view;  // represents the world coordinates in the camera coord space
+   vec4 camPosition; // so we can compute the view vector
+   vec4 ambientLightColor;
+   vec4 lightPositions[4];
+   vec4 lightColors[4];
+   vec4 lightAttenuation; // c0, c1, c2 and number of lights
+};
@@ -5,30 +5,15 @@ layout (location = 2) in vec2 textCoord; // here for completness, but we are not
 
 uniform mat4 model; // represents model coordinates in the world coord space
 uniform mat4 invTransposeModel; // inverse of the transpose of  model (used to multiply vectors while preserving angles)
-uniform mat4 view;  // represents the world coordinates in the camera coord space
-uniform mat4 projection; // camera projection matrix
-uniform vec3 camPosition; // so we can compute the view vector (could be extracted from view matrix, but let's make our life easier :) )
 
-// send shaded color to the fragment shader
-out vec4 shadedColor;
-
-// TODO exercise 8 setup the uniform variables needed for lighting
-// light uniform variables
-uniform vec3 ambientLightColor;
-uniform vec3 light1Position;
-uniform vec3 light1Color;
+// FrameUniforms block, material uniforms and the Phong reflection model
+#include "lighting.glsl"
 
-// material properties
-uniform vec3 reflectionColor;
-uniform float ambientReflectance;
-uniform float diffuseReflectance;
-uniform float specularReflectance;
-uniform float specularExponent;
+// the depth pre-pass (depth_only.vert) computes gl_Position the same way, and must get the same depth
+invariant gl_Position;
 
-// attenuation uniforms
-uniform float attenuationC0;
-uniform float attenuationC1;
-uniform float attenuationC2;
+// send shaded color to the fragment shader
+out vec4 shadedColor;
 
 void main() {
    // vertex in world space (for light computation)
@@ -39,28 +24,6 @@ void main() {
    // final vertex transform (for opengl rendering, not for lighting)
    gl_Position = projection * view * P;
 
-   // TODO exercises 8.1, 8.2 and 8.3 - Gouraud shading (i.e. Phong reflection model computed in the vertex shader)
-
-   // TODO 8.1 ambient
-   vec3 ambient = ambientLightColor * ambientReflectance * reflectionColor;
-
-   // TODO 8.2 diffuse
-   vec3 L = normalize(light1Position - P.xyz);
-   float diffuseModulation = max(dot(N, L), 0.0);
-   vec3 diffuse = light1Color * diffuseReflectance * diffuseModulation * reflectionColor;
-
-   // TODO 8.3 specular
-   vec3 R =  -L - 2 * dot(-L, N) * N; // the same as reflect(-L_eye, normal)
-   float specModulation = pow(max(dot(R, normalize(camPosition - P.xyz)), 0.0), specularExponent);
-   vec3 specular = light1Color * specularReflectance * specModulation;
-   // notice that I did not use the material color (reflectionColor) in the specular, that is because most materials
-   // do not affect the specular highlight color, with exception of metals (you can play with that)
-
-   // TODO exercise 8.6 - attenuation - light 1
-   float distance = length(P.xyz - light1Position);
-   float attenuation =  1.0 / (attenuationC0 + attenuationC1 * distance + attenuationC2 * distance * distance);
-
-   // TODO set the output color to the shaded color that you have computed
-   shadedColor = vec4(ambient + (diffuse + specular) * attenuation, 1);
-
-}
\ No newline at end of file
+   // exercises 8.1, 8.2, 8.3 and 8.6 - Gouraud shading (i.e. Phong reflection model computed in the vertex shader)
+   shadedColor = vec4(frameLights(P.xyz, N), 1);
+}
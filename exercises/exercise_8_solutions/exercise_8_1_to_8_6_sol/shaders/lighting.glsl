@@ -0,0 +1,53 @@
+// Phong reflection model, shared by the Gouraud (per vertex) and Phong (per fragment) shaders
+#include "frame_uniforms.glsl"
+
+// number of lights of the FrameUniforms block that are shaded, set by the application (see shader_preprocessor.h),
+// a constant loop count lets the compiler unroll the light loop
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 2
+#endif
+
+// material uniforms
+uniform vec3 reflectionColor;
+uniform float ambientReflectance;
+uniform float diffuseReflectance;
+uniform float specularReflectance;
+uniform float specularExponent;
+
+vec3 ambientLight()
+{
+   return ambientLightColor.rgb * ambientReflectance * reflectionColor;
+}
+
+// diffuse and specular light reflected towards the camera at world space position P with normal N,
+// from a light at 'lightPosition'
+vec3 pointLight(vec3 P, vec3 N, vec3 lightPosition, vec3 lightColor)
+{
+   vec3 L = lightPosition - P;
+   float distance = length(L);
+   L /= distance;
+
+   // diffuse component
+   float diffuseModulation = max(dot(N, L), 0.0);
+   vec3 diffuse = lightColor * diffuseReflectance * diffuseModulation * reflectionColor;
+
+   // specular component
+   // notice that the material color (reflectionColor) is not used in the specular, that is because most materials
+   // do not affect the specular highlight color, with exception of metals
+   vec3 R = -L - 2 * dot(-L, N) * N; // the same as reflect(-L, N)
+   float specModulation = pow(max(dot(R, normalize(camPosition.xyz - P)), 0.0), specularExponent);
+   vec3 specular = lightColor * specularReflectance * specModulation;
+
+   // attenuation
+   float attenuation = 1.0 / (lightAttenuation.x + lightAttenuation.y * distance + lightAttenuation.z * distance * distance);
+   return (diffuse + specular) * attenuation;
+}
+
+// ambient light plus the first LIGHT_COUNT lights of the FrameUniforms block
+vec3 frameLights(vec3 P, vec3 N)
+{
+   vec3 color = ambientLight();
+   for (int i = 0; i < LIGHT_COUNT; i++)
+      color += pointLight(P, N, lightPositions[i].xyz, lightColors[i].rgb);
+   return color;
+}
@@ -1,75 +1,60 @@
 #version 330 core
 
-uniform vec3 camPosition; // so we can compute the view vector
 out vec4 FragColor; // the output color of this fragment
 
-// TODO exercise 8.4 setup the 'uniform' variables needed for lighting
-// light uniforms
-uniform vec3 ambientLightColor;
-uniform vec3 light1Position;
-uniform vec3 light1Color;
-uniform vec3 light2Position;
-uniform vec3 light2Color;
+// FrameUniforms block, material uniforms and the Phong reflection model
+#include "lighting.glsl"
 
-// material uniforms
-uniform vec3 reflectionColor;
-uniform float ambientReflectance;
-uniform float diffuseReflectance;
-uniform float specularReflectance;
-uniform float specularExponent;
-
-// attenuation uniforms
-uniform float attenuationC0;
-uniform float attenuationC1;
-uniform float attenuationC2;
+#ifdef CLUSTERED_LIGHTS
+// clustered lights (see light_clusters.h), shaded on top of the LIGHT_COUNT lights of the FrameUniforms block
+uniform samplerBuffer lightData;     // 2 texels per light: position and radius, color
+uniform usamplerBuffer clusterGrid;  // per cluster: offset in lightIndices and number of lights
+uniform usamplerBuffer lightIndices; // the lights of each cluster
+uniform uvec3 clusterCount;          // number of clusters in x, y and z
+uniform vec2 clusterTileSize;        // size of a cluster on screen, in pixels
+uniform vec2 clusterDepth;           // near plane, and number of slices / log(far / near)
+#endif
 
 // TODO exercise 8.4 add the 'in' variables to receive the interpolated Position and Normal from the vertex shader
 in vec3 P_frag;
 in vec3 N_frag;
 
-void main()
+#ifdef CLUSTERED_LIGHTS
+// the cluster grid is indexed by x, then y, then depth slice
+uint clusterIndex()
 {
+   float depth = -(view * vec4(P_frag, 1.0)).z;
+   uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), clusterCount.xy - 1u);
+   uint slice = uint(clamp(log(depth / clusterDepth.x) * clusterDepth.y, 0.0, float(clusterCount.z - 1u)));
+   return (slice * clusterCount.y + tile.y) * clusterCount.x + tile.x;
+}
 
-   // TODO exercise 8.4 - phong shading (i.e. Phong reflection model computed in the fragment shader)
-   // ambient component
-   vec3 ambient = ambientLightColor * ambientReflectance * reflectionColor;
-   vec4 color = vec4(ambient,1);
-
-   // diffuse component for light 1
-   vec3 L = normalize(light1Position - P_frag);
-   float diffuseModulation = max(dot(N_frag, L), 0.0);
-   vec3 diffuse = light1Color * diffuseReflectance * diffuseModulation * reflectionColor;
-
-   // specular component for light 1
-   vec3 R =  -L - 2 * dot(-L, N_frag) * N_frag; // the same as reflect(-L_eye, normal)
-   float specModulation = pow(max(dot(R, normalize(camPosition - P_frag)), 0.0), specularExponent);
-   vec3 specular = light1Color * specularReflectance * specModulation;
-
-   // TODO exercuse 8.6 - attenuation - light 1
-   float distance = length(light1Position - P_frag);
-   float attenuation =  1.0 / (attenuationC0 + attenuationC1 * distance + attenuationC2 * distance * distance);
-   color.xyz += (diffuse + specular) * attenuation;
-
-
-   // TODO exercise 8.5 - multiple lights, compute diffuse and specular of light 2
-   // diffuse component for light 1
-   L = normalize(light2Position - P_frag);
-   diffuseModulation = max(dot(N_frag, L), 0.0);
-   diffuse = light2Color * diffuseReflectance * diffuseModulation * reflectionColor;
-
-   // specular component for light 1
-   R =  -L - 2 * dot(-L, N_frag) * N_frag; // the same as reflect(-L_eye, normal)
-   specModulation = pow(max(dot(R, normalize(camPosition - P_frag)), 0.0), specularExponent);
-   specular = light2Color * specularReflectance * specModulation;
-
-   // TODO exercuse 8.6 - attenuation - light 2
-   distance = length(P_frag - light2Position);
-   attenuation =  1.0 / (attenuationC0 + attenuationC1 * distance + attenuationC2 * distance * distance);
-   color.xyz += (diffuse + specular) * attenuation;
-
+// only the lights that reach the cluster of this fragment are shaded
+vec3 clusterLights()
+{
+   vec3 color = vec3(0);
+   uvec2 cluster = texelFetch(clusterGrid, int(clusterIndex())).xy;
+   for (uint i = 0u; i < cluster.y; i++)
+   {
+      int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);
+      vec4 positionRadius = texelFetch(lightData, light * 2);
+      vec3 lightColor = texelFetch(lightData, light * 2 + 1).rgb;
+
+      // faded to 0 at the radius of the light, so that it ends at the clusters it was assigned to
+      float distance = length(positionRadius.xyz - P_frag);
+      float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+      color += pointLight(P_frag, N_frag, positionRadius.xyz, lightColor) * window * window;
+   }
+   return color;
+}
+#endif
 
-   // TODO set the output color to the shaded color that you have computed
-   FragColor = color;
+void main()
+{
+   // exercises 8.4, 8.5 and 8.6 - phong shading (i.e. Phong reflection model computed in the fragment shader)
+   vec3 color = frameLights(P_frag, N_frag);
+#ifdef CLUSTERED_LIGHTS
+   color += clusterLights();
+#endif
+   FragColor = vec4(color, 1);
 }
-// you might have noticed that the shading contribution of multiple lights can fit a for loop nicely
-// we will be doing that later on
\ No newline at end of file
@@ -4,9 +4,12 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 textCoord; // here for completness, but we are not using it just yet
 
 uniform mat4 model; // represents model coordinates in the world coord space
-uniform mat4 view;  // represents the world coordinates in the camera coord space
 uniform mat4 invTransposeModel; // inverse of the transpose of model (used to multiply vectors while preserving angles)
-uniform mat4 projection; // camera projection matrix
+
+#include "frame_uniforms.glsl"
+
+// the depth pre-pass (depth_only.vert) computes gl_Position the same way, and must get the same depth
+invariant gl_Position;
 
 // TODO exercise 8.4 - make the 'out' variables that will be used in the fragment shader
 out vec3 P_frag;
@@ -4,11 +4,22 @@
 
 #include <vector>
 #include <chrono>
+#include <cstdlib>
+#include <string>
 
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
 
+#include <uniform_buffer.h>
+#include <frame_uniforms.h>
+#include <render_queue.h>
+#include <occlusion_culler.h>
+#include <gl_state.h>
+#include <frame_capture.h>
+#include <profiler.h>
+#include <gpu_profiler.h>
+
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -16,9 +27,15 @@
 // function declarations
 // ---------------------
 void loadFloorTexture();
+void updateFrameUniforms();
 void drawCar();
 void drawFloor();
 void drawGui();
+#ifdef ITU_PROFILER
+void drawProfiler();
+#endif
+void drawGpuProfiler();
+float cameraDistance(const glm::mat4 &model);
 
 // glfw and input functions
 // ------------------------
@@ -36,7 +53,10 @@ const unsigned int SCR_HEIGHT = 720;
 // global variables used for rendering
 // -----------------------------------
 Shader* carShader;
+Shader* carInstancedShader;
 Shader* floorShader;
+Shader* depthShader;
+Shader* depthInstancedShader;
 Model* carPaint;
 Model* carBody;
 Model* carInterior;
@@ -45,6 +65,11 @@ Model* carWindow;
 Model* carWheel;
 Model* floorModel;
 unsigned int floorTextureId;
+UniformBuffer* frameUniformBuffer;
+RenderQueue renderQueue;
+OcclusionCuller* occlusionCuller;
+FrameCapture* frameCapture;
+GpuProfiler* gpuProfiler;
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
 
 // global variables used for control
@@ -88,8 +113,19 @@ struct Config {
 
 
 
-int main()
+int main(int argc, char** argv)
 {
+    // headless GPU profile: 'exercise_9 --gpu-profile <frames> <file.csv>' renders <frames> frames in a hidden
+    // window, without the GUI, writes the pass timings to <file.csv> and prints their averages
+    // (with Mesa, LIBGL_ALWAYS_SOFTWARE=1 runs it on the CPU, on a machine without GPU)
+    unsigned int profileFrames = 0;
+    const char* profileCsv = nullptr;
+    if (argc == 4 && std::string(argv[1]) == "--gpu-profile")
+    {
+        profileFrames = (unsigned int) std::max(1, std::atoi(argv[2]));
+        profileCsv = argv[3];
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -100,6 +136,8 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
+    if (profileFrames > 0)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // glfw window creation
     // --------------------
@@ -134,7 +172,10 @@ int main()
 
 
     carShader = new Shader("shaders/car_shader.vert", "shaders/car_shader.frag");
+    carInstancedShader = new Shader("shaders/car_shader_instanced.vert", "shaders/car_shader.frag");
     floorShader = new Shader("shaders/floor_Shader.vert", "shaders/floor_Shader.frag");
+    depthShader = new Shader("shaders/depth_only.vert", "shaders/depth_only.frag");
+    depthInstancedShader = new Shader("shaders/depth_only_instanced.vert", "shaders/depth_only.frag");
 	carPaint = new Model("car/Paint_LOD0.obj");
 	carBody = new Model("car/Body_LOD0.obj");
 	carLight = new Model("car/Light_LOD0.obj");
@@ -143,6 +184,27 @@ int main()
 	carWheel = new Model("car/Wheel_LOD0.obj");
 	floorModel = new Model("floor/floor_no_material.obj");
 
+    // camera and light uniforms shared by both programs, updated once per frame
+    carShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    carInstancedShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    floorShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    depthShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    depthInstancedShader->setUniformBlockBinding("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    frameUniformBuffer = new UniformBuffer(sizeof(FrameUniforms), FRAME_UNIFORMS_BINDING);
+
+    // the interior and the wheels are often hidden behind the body, their bounding boxes are tested
+    // against the depth buffer once the opaque objects are drawn
+    occlusionCuller = new OcclusionCuller();
+    frameCapture = new FrameCapture();
+    // GPU time of the passes, shown in the GUI
+    gpuProfiler = new GpuProfiler();
+    renderQueue.setGpuProfiler(gpuProfiler);
+    if (profileCsv && !gpuProfiler->startCsv(profileCsv))
+        std::cout << "ERROR::GPU_PROFILER::FILE_NOT_OPENED " << profileCsv << std::endl;
+    // the depth pre-pass is off by default, it can be turned on in the GUI
+    renderQueue.setDepthPrepass(false, depthShader->ID, depthInstancedShader->ID);
+    renderQueue.setPassEndCallback(RenderQueue::OPAQUE_PASS, [](){ occlusionCuller->issueQueries(); });
+
     // set up the z-buffer
     glDepthRange(-1,1); // make the NDC a right handed coordinate system, with the camera pointing towards -z
     glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
@@ -170,23 +232,60 @@ int main()
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        GLState::newFrame();
+        PROFILE_FRAME();
+        gpuProfiler->beginFrame();
 
         processInput(window);
 
-        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        {
+            GpuProfiler::Scope gpuScope(gpuProfiler, "clear");
+            glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
 
+        updateFrameUniforms();
+        // drawFloor and drawCar submit their draws to the render queue, which issues them sorted by GL state,
+        // so the floor and the car are timed together, in the passes of the queue
         drawFloor();
         drawCar();
-		if (isPaused) {
+        {
+            GpuProfiler::Scope gpuScope(gpuProfiler, "render queue");
+            renderQueue.execute();
+        }
+        // captured before the GUI is drawn on top
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        {
+            GpuProfiler::Scope gpuScope(gpuProfiler, "frame capture");
+            frameCapture->captureFrame(framebufferWidth, framebufferHeight);
+        }
+		if (isPaused && profileFrames == 0) {
+			GpuProfiler::Scope gpuScope(gpuProfiler, "GUI");
 			drawGui();
+			// ImGui binds its own program, VAO and texture
+			GLState::invalidate();
 		}
-
-        glfwSwapBuffers(window);
+        gpuProfiler->endFrame();
+        if (profileFrames > 0 && gpuProfiler->resolvedFrames + gpuProfiler->droppedFrames >= profileFrames)
+            glfwSetWindowShouldClose(window, true);
+
+        {
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    if (profileFrames > 0)
+    {
+        std::cout << gpuProfiler->resolvedFrames << " frames profiled, " << gpuProfiler->droppedFrames << " dropped" << std::endl;
+        for (const GpuProfiler::PassStats &pass : gpuProfiler->getPasses())
+            std::cout << std::string(pass.depth * 2, ' ') << pass.name << ": " << pass.averageMs << " ms average, "
+                      << pass.maxMs << " ms max" << std::endl;
+    }
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -202,6 +301,13 @@ int main()
     delete carWheel;
     delete floorShader;
     delete carShader;
+    delete carInstancedShader;
+    delete depthShader;
+    delete depthInstancedShader;
+    delete frameUniformBuffer;
+    delete occlusionCuller;
+    delete frameCapture;
+    delete gpuProfiler;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -225,6 +331,7 @@ void loadFloorTexture(){
 // --------------
 
 void drawGui(){
+    PROFILE_FUNCTION();
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -280,7 +387,49 @@ void drawGui(){
 
         ImGui::Separator();
 
+        const RenderQueue::Stats &queueStats = renderQueue.lastStats();
+        ImGui::Text("Frustum culling: %u of %u meshes culled", queueStats.culled, queueStats.submitted);
+        const OcclusionCuller::Stats &occlusionStats = occlusionCuller->getStats();
+        ImGui::Checkbox("occlusion culling", &occlusionCuller->enabled);
+        ImGui::Text("Occlusion culling: %u of %u meshes occluded, %u boxes tested",
+                    occlusionStats.occluded, occlusionStats.tracked, occlusionStats.tested);
+        // the shading cost is measured with and without the depth pre-pass, switch it on and off to compare
+        static float opaqueMs[2] = {0.0f, 0.0f}, depthPrepassMs = 0.0f;
+        bool depthPrepass = renderQueue.isDepthPrepassOn();
+        opaqueMs[depthPrepass] = queueStats.opaqueMs;
+        if (depthPrepass)
+            depthPrepassMs = queueStats.depthPrepassMs;
+        if (ImGui::Checkbox("depth pre-pass", &depthPrepass))
+            renderQueue.setDepthPrepass(depthPrepass);
+        ImGui::Text("Opaque shading: %.3f ms without pre-pass, %.3f ms with pre-pass (+ %.3f ms depth only)",
+                    opaqueMs[0], opaqueMs[1], depthPrepassMs);
+        ImGui::Text("Render queue: %u draws, %u program, %u VAO and %u texture binds (%u binds saved)",
+                    queueStats.draws, queueStats.programBinds, queueStats.vaoBinds, queueStats.textureBinds, queueStats.savedBinds);
+        ImGui::Text("GL state: %u binds issued, %u elided", GLState::lastFrame().issued, GLState::lastFrame().elided);
+        ImGui::Separator();
+
+        // screenshots and videos are written to the working directory
+        static unsigned int screenshotCount = 0, videoCount = 0;
+        if (ImGui::Button("screenshot"))
+            frameCapture->screenshot("screenshot_" + std::to_string(screenshotCount++) + ".png");
+        ImGui::SameLine();
+        if (!frameCapture->isRecording() && ImGui::Button("record video"))
+            frameCapture->startRecording("capture_" + std::to_string(videoCount++) + ".y4m", 60);
+        else if (frameCapture->isRecording() && ImGui::Button("stop recording"))
+            frameCapture->stopRecording();
+        bool waitForEncoder = frameCapture->dropPolicy == FrameCapture::WAIT_FOR_ENCODER;
+        if (ImGui::Checkbox("wait for encoder (no dropped frames)", &waitForEncoder))
+            frameCapture->dropPolicy = waitForEncoder ? FrameCapture::WAIT_FOR_ENCODER : FrameCapture::DROP_FRAMES;
+        ImGui::Text("Capture: %u frames recorded, %u dropped, %u waiting for the encoder",
+                    frameCapture->recordedFrames, frameCapture->droppedFrames, frameCapture->queuedFrames());
+
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Separator();
+        drawGpuProfiler();
+#ifdef ITU_PROFILER
+        ImGui::Separator();
+        drawProfiler();
+#endif
         ImGui::End();
     }
 
@@ -289,121 +438,196 @@ void drawGui(){
 }
 
 
+// average and maximum GPU time of the passes over the last GpuProfiler::HISTORY frames
+void drawGpuProfiler(){
+    ImGui::Text("GPU passes (%u frames read back, %u dropped)", gpuProfiler->resolvedFrames, gpuProfiler->droppedFrames);
+    ImGui::Columns(3, "gpu passes");
+    ImGui::Text("pass"); ImGui::NextColumn();
+    ImGui::Text("average"); ImGui::NextColumn();
+    ImGui::Text("max"); ImGui::NextColumn();
+    for (const GpuProfiler::PassStats &pass : gpuProfiler->getPasses()) {
+        ImGui::Text("%*s%s", (int) pass.depth * 2, "", pass.name.c_str()); ImGui::NextColumn();
+        ImGui::Text("%.3f ms", pass.averageMs); ImGui::NextColumn();
+        ImGui::Text("%.3f ms", pass.maxMs); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    bool writeCsv = gpuProfiler->isWritingCsv();
+    if (ImGui::Checkbox("write GPU timings to gpu_profile.csv", &writeCsv)) {
+        if (writeCsv)
+            gpuProfiler->startCsv("gpu_profile.csv");
+        else
+            gpuProfiler->stopCsv();
+    }
+}
+
+
+#ifdef ITU_PROFILER
+// flame bar of the PROFILE_SCOPEs of the main thread over the last frames, one row per nesting depth
+void drawProfiler(){
+    static int frameCount = 3;
+    ImGui::SliderInt("profiled frames", &frameCount, 1, 30);
+
+    std::uint64_t begin, end, lastFrameBegin, frameEnd;
+    if (!Profiler::frameRange(frameCount, begin, frameEnd) || !Profiler::frameRange(1, lastFrameBegin, end)) {
+        ImGui::Text("Profiler: not enough frames yet");
+        return;
+    }
+    std::vector<Profiler::Event> events = Profiler::mainThreadEvents(begin, end);
+    unsigned int depth = 1;
+    for (const Profiler::Event &event : events)
+        depth = std::max(depth, event.depth + 1);
+
+    float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+    float width = ImGui::GetContentRegionAvail().x;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("flame bar", ImVec2(width, rowHeight * depth));
+    bool hovered = ImGui::IsItemHovered();
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    double pixelsPerNs = width / (double) (end - begin);
+
+    for (const Profiler::Event &event : events) {
+        float x0 = origin.x + (float) ((std::max(event.begin, begin) - begin) * pixelsPerNs);
+        float x1 = origin.x + (float) ((std::min(event.end, end) - begin) * pixelsPerNs);
+        x1 = std::max(x1, x0 + 1.0f);
+        float y0 = origin.y + event.depth * rowHeight, y1 = y0 + rowHeight - 1.0f;
+        // the color only depends on the name, a scope keeps its color from frame to frame
+        std::uint32_t hash = 2166136261u;
+        for (const char* c = event.name; *c; c++)
+            hash = (hash ^ (unsigned char) *c) * 16777619u;
+        ImU32 color = IM_COL32(90 + hash % 140, 90 + (hash >> 8) % 140, 90 + (hash >> 16) % 140, 255);
+        drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), color);
+        if (x1 - x0 > ImGui::CalcTextSize(event.name).x + 4.0f)
+            drawList->AddText(ImVec2(x0 + 2.0f, y0 + 1.0f), IM_COL32(0, 0, 0, 255), event.name);
+        if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+            ImGui::SetTooltip("%s: %.3f ms", event.name, (event.end - event.begin) / 1.0e6);
+    }
+    // frame boundaries
+    for (int i = 1; i < frameCount; i++) {
+        std::uint64_t frameBegin;
+        Profiler::frameRange(i, frameBegin, frameEnd);
+        float x = origin.x + (float) ((frameBegin - begin) * pixelsPerNs);
+        drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + rowHeight * depth), IM_COL32(255, 255, 255, 255));
+    }
+
+    ImGui::Text("Last frame: %.3f ms", (end - lastFrameBegin) / 1.0e6);
+    // open it in chrome://tracing or ui.perfetto.dev
+    if (ImGui::Button("export chrome trace"))
+        Profiler::writeChromeTrace("profile.json");
+}
+#endif
+
+
+// camera, light and attenuation parameters are shared by all programs and objects in a frame,
+// so we upload them once per frame to a uniform buffer instead of setting them for every draw
+void updateFrameUniforms(){
+    PROFILE_FUNCTION();
+    FrameUniforms frame;
+
+    // camera parameters
+    frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    frame.view = camera.GetViewMatrix();
+    frame.camPosition = glm::vec4(camera.Position, 1.0f);
+
+    // light parameters
+    frame.ambientLightColor = glm::vec4(config.ambientLightColor * config.ambientLightIntensity, 1.0f);
+    frame.lightPositions[0] = glm::vec4(config.lightPosition, 1.0f);
+    frame.lightColors[0] = glm::vec4(config.lightColor * config.lightIntensity, 1.0f);
+
+    // attenuation, and number of lights in use
+    frame.lightAttenuation = glm::vec4(config.attenuationC0, config.attenuationC1, config.attenuationC2, 1.0f);
+
+    frameUniformBuffer->update(frame);
+
+    // meshes outside of the view frustum are dropped by the render queue
+    renderQueue.setFrustum(Frustum::fromMatrix(frame.projection * frame.view));
+    occlusionCuller->newFrame(frame.projection * frame.view);
+}
+
+
 void drawFloor(){
+    PROFILE_FUNCTION();
     floorShader->use();
-    // light uniforms
-    floorShader->setVec3("ambientLightColor", config.ambientLightColor * config.ambientLightIntensity);
-    floorShader->setVec3("lightPosition", config.lightPosition);
-    floorShader->setVec3("lightColor", config.lightColor * config.lightIntensity);
+    // camera, light and attenuation uniforms are set once per frame in updateFrameUniforms()
 
     // material uniforms
     floorShader->setFloat("specularExponent", config.specularExponent);
 
-    // attenuation uniforms
-    floorShader->setFloat("attenuationC0", config.attenuationC0);
-    floorShader->setFloat("attenuationC1", config.attenuationC1);
-    floorShader->setFloat("attenuationC2", config.attenuationC2);
-
     // TODO exercise 9.2 send uvScale to the shader as a uniform variable
 
 
 
-    // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    // the view matrix is still needed to compute the normal transformation
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
-
-    // set projection matrix uniform
-    floorShader->setMat4("projection", projection);
 
-    glActiveTexture(GL_TEXTURE0);
     floorShader->setInt("texture_diffuse1", 0);
-    glBindTexture(GL_TEXTURE_2D, floorTextureId);
     // draw floor,
     // notice that we overwrite the value of one of the uniform variables to set a different floor color
     floorShader->setVec3("reflectionColor", .2, .5, .2);
     glm::mat4 model = glm::scale(glm::mat4(1.0), glm::vec3(5.f, 5.f, 5.f));
-    floorShader->setMat4("model", model);
     glm::mat4 invTranspose = glm::inverse(glm::transpose(view * model));
-    floorShader->setMat4("invTranspMV", invTranspose);
-    floorShader->setMat4("view", view);
-    floorModel->Draw(*floorShader);
+    auto setUniforms = [model, invTranspose]() {
+        floorShader->setMat4("model", model);
+        floorShader->setMat4("invTranspMV", invTranspose);
+    };
+    // the floor mesh has no material, the floor texture goes to unit 0
+    for (Mesh &mesh : floorModel->meshes) {
+        RenderQueue::Draw draw = mesh.MakeDraw(*floorShader, model, setUniforms);
+        draw.textures[0] = floorTextureId;
+        draw.textureCount = 1;
+        draw.material = floorTextureId;
+        renderQueue.submit(RenderQueue::OPAQUE_PASS, cameraDistance(model), draw);
+    }
 }
 
 
 void drawCar(){
+    PROFILE_FUNCTION();
+    // draw the four wheels with a single instanced draw call per mesh
+    carInstancedShader->use();
+    carInstancedShader->setFloat("ambientOcclusionMix", config.ambientOcclusionMix);
+    carInstancedShader->setFloat("specularExponent", config.specularExponent);
+
+    glm::mat4 wheels[4];
+    wheels[0] = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, 1.39));
+    wheels[1] = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296));
+    wheels[2] = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    wheels[2] = glm::translate(wheels[2], glm::vec3(-.7432, .328, 1.296));
+    wheels[3] = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    wheels[3] = glm::translate(wheels[3], glm::vec3(-.7432, .328, -1.39));
+    carWheel->SubmitInstanced(renderQueue, *carInstancedShader, RenderQueue::OPAQUE_PASS, cameraDistance(glm::mat4(1.0f)), wheels, 4, nullptr, occlusionCuller);
+
     carShader->use();
-    // light uniforms
-    carShader->setVec3("ambientLightColor", config.ambientLightColor * config.ambientLightIntensity);
-    carShader->setVec3("lightPosition", config.lightPosition);
-    carShader->setVec3("lightColor", config.lightColor * config.lightIntensity);
+    // camera, light and attenuation uniforms are set once per frame in updateFrameUniforms()
 
     // material uniforms
     carShader->setFloat("ambientOcclusionMix", config.ambientOcclusionMix);
     carShader->setFloat("specularExponent", config.specularExponent);
 
-    // attenuation uniforms
-    carShader->setFloat("attenuationC0", config.attenuationC0);
-    carShader->setFloat("attenuationC1", config.attenuationC1);
-    carShader->setFloat("attenuationC2", config.attenuationC2);
-
-
-    // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    // the view matrix is still needed to compute the normal transformation
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
-
-    // set projection matrix uniform
-    carShader->setMat4("projection", projection);
 
-    // draw wheel
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, 1.39));
-    carShader->setMat4("model", model);
+    // draw the rest of the car
+    glm::mat4 model = glm::mat4(1.0f);
     glm::mat4 invTranspose = glm::inverse(glm::transpose(view * model));
-    carShader->setMat4("invTranspMV", invTranspose);
-    carShader->setMat4("view", view);
-    carWheel->Draw(*carShader);
-
-    // draw wheel
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296));
-    carShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    carShader->setMat4("invTranspMV", invTranspose);
-    carShader->setMat4("view", view);
-    carWheel->Draw(*carShader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, 1.296));
-    carShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    carShader->setMat4("invTranspMV", invTranspose);
-    carShader->setMat4("view", view);
-    carWheel->Draw(*carShader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, -1.39));
-    carShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    carShader->setMat4("invTranspMV", invTranspose);
-    carShader->setMat4("view", view);
-    carWheel->Draw(*carShader);
+    auto setUniforms = [model, invTranspose]() {
+        carShader->setMat4("model", model);
+        carShader->setMat4("invTranspMV", invTranspose);
+    };
+    float depth = cameraDistance(model);
+    carBody->Submit(renderQueue, *carShader, RenderQueue::OPAQUE_PASS, depth, model, setUniforms);
+    carInterior->Submit(renderQueue, *carShader, RenderQueue::OPAQUE_PASS, depth, model, setUniforms, occlusionCuller);
+    carPaint->Submit(renderQueue, *carShader, RenderQueue::OPAQUE_PASS, depth, model, setUniforms);
+    carLight->Submit(renderQueue, *carShader, RenderQueue::OPAQUE_PASS, depth, model, setUniforms);
+    // the windows are drawn with blending, after all the opaque draws
+    carWindow->Submit(renderQueue, *carShader, RenderQueue::BLENDED_PASS, depth, model, setUniforms);
 
-    // draw the rest of the car
-    model = glm::mat4(1.0f);
-    carShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    carShader->setMat4("invTranspMV", invTranspose);
-    carShader->setMat4("view", view);
-    carBody->Draw(*carShader);
-    carInterior->Draw(*carShader);
-    carPaint->Draw(*carShader);
-    carLight->Draw(*carShader);
-    glEnable(GL_BLEND);
-    carWindow->Draw(*carShader);
-    glDisable(GL_BLEND);
+}
 
+// distance from the camera to the origin of an object, used to sort the draws of the render queue
+float cameraDistance(const glm::mat4 &model){
+    return glm::length(glm::vec3(model[3]) - camera.Position);
 }
 
 // ---------------
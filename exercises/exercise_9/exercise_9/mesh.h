@@ -7,12 +7,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <render_queue.h>
+#include <gl_state.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 struct Vertex {
@@ -28,6 +31,14 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// per-instance attributes used by Mesh::DrawInstanced, read at locations 5 to 11 of the instanced shaders
+struct InstanceData {
+    // model matrix, locations 5 to 8
+    glm::mat4 Model;
+    // inverse of the transpose of the model matrix, locations 9 to 11
+    glm::mat3 NormalMatrix;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -41,6 +52,12 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    unsigned int instanceVBO = 0; // instance buffer the VAO currently reads per-instance attributes from
+    GLintptr instanceOffset = -1; // and offset of the attributes in that buffer
+    /*  Bounding volumes (model space)  */
+    glm::vec3 aabbMin, aabbMax;
+    glm::vec3 sphereCenter;
+    float sphereRadius;
 
     /*  Functions  */
     // constructor
@@ -52,19 +69,115 @@ public:
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        computeBounds();
     }
 
     // render the mesh
     void Draw(Shader shader)
     {
-        // bind appropriate textures
+        bindTextures(shader);
+
+        // draw mesh, the VAO stays bound so that the next draw of the same mesh does not bind it again
+        GLState::bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    }
+
+    // render 'instanceCount' copies of the mesh in a single draw call,
+    // the per-instance attributes are read from the InstanceData array stored in 'instanceBuffer' at 'offset'
+    void DrawInstanced(Shader shader, unsigned int instanceBuffer, GLintptr offset, unsigned int instanceCount)
+    {
+        if (instanceVBO != instanceBuffer || instanceOffset != offset)
+            setupInstanceAttributes(instanceBuffer, offset);
+
+        bindTextures(shader);
+
+        GLState::bindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+    }
+
+    // build the render queue draw of the mesh, 'setUniforms' sets the uniforms of the object the mesh belongs to
+    // and 'model' places the bounding sphere used for culling in the world
+    // (the mesh and the shader must outlive the execution of the queue)
+    RenderQueue::Draw MakeDraw(Shader &shader, const glm::mat4 &model, const std::function<void()> &setUniforms)
+    {
+        RenderQueue::Draw draw;
+        SetBounds(draw, transformSphere(model, sphereCenter, sphereRadius));
+        draw.program = shader.ID;
+        draw.model = model;
+        draw.VAO = VAO;
+        draw.count = indices.size();
+        draw.textureCount = std::min((unsigned int) textures.size(), RenderQueue::MAX_TEXTURES);
+        for (unsigned int i = 0; i < draw.textureCount; i++)
+            draw.textures[i] = textures[i].id;
+        // meshes of the same material share their first texture
+        draw.material = draw.textureCount > 0 ? textures[0].id : 0;
+
+        Mesh* mesh = this;
+        Shader* program = &shader;
+        draw.setUniforms = [mesh, program, setUniforms]() {
+            mesh->setSamplers(*program);
+            if (setUniforms)
+                setUniforms();
+        };
+        return draw;
+    }
+
+    // same as MakeDraw, for the instances read from 'instanceBuffer' at 'offset' (see DrawInstanced),
+    // the bounding sphere contains the spheres of all the instances
+    RenderQueue::Draw MakeInstancedDraw(Shader &shader, unsigned int instanceBuffer, GLintptr offset, const glm::mat4* modelMatrices,
+                                        unsigned int instanceCount, const std::function<void()> &setUniforms)
+    {
+        if (instanceVBO != instanceBuffer || instanceOffset != offset)
+            setupInstanceAttributes(instanceBuffer, offset);
+
+        RenderQueue::Draw draw = MakeDraw(shader, glm::mat4(1.0f), setUniforms);
+        draw.instanceCount = instanceCount;
+
+        glm::vec3 center(0.0f);
+        for (unsigned int i = 0; i < instanceCount; i++)
+            center += glm::vec3(modelMatrices[i] * glm::vec4(sphereCenter, 1.0f));
+        center /= (float) instanceCount;
+        float radius = 0.0f;
+        for (unsigned int i = 0; i < instanceCount; i++)
+        {
+            glm::vec4 sphere = transformSphere(modelMatrices[i], sphereCenter, sphereRadius);
+            radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+        }
+        SetBounds(draw, glm::vec4(center, radius));
+        return draw;
+    }
+
+    // world space bounding sphere (xyz: center, w: radius) of a draw
+    static void SetBounds(RenderQueue::Draw &draw, const glm::vec4 &sphere)
+    {
+        draw.bounds[0] = sphere.x;
+        draw.bounds[1] = sphere.y;
+        draw.bounds[2] = sphere.z;
+        draw.bounds[3] = sphere.w;
+    }
+
+private:
+    /*  Render data  */
+    unsigned int VBO, EBO;
+
+    /*  Functions    */
+    // bind the textures of the mesh and set the sampler uniforms accordingly
+    void bindTextures(Shader &shader)
+    {
+        setSamplers(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+            GLState::bindTextureUnit(i, GL_TEXTURE_2D, textures[i].id);
+    }
+
+    // point each sampler uniform of 'shader' to the texture unit of the matching texture
+    void setSamplers(Shader &shader)
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int ambientNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -79,24 +192,28 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    /*  Render data  */
-    unsigned int VBO, EBO;
+    // axis aligned box around the vertices, and a sphere centered in the box that contains all the vertices
+    void computeBounds()
+    {
+        aabbMin = aabbMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for (const Vertex &vertex : vertices)
+        {
+            aabbMin = glm::min(aabbMin, vertex.Position);
+            aabbMax = glm::max(aabbMax, vertex.Position);
+        }
+        sphereCenter = (aabbMin + aabbMax) * 0.5f;
+        float radius2 = 0.0f;
+        for (const Vertex &vertex : vertices)
+        {
+            glm::vec3 d = vertex.Position - sphereCenter;
+            radius2 = std::max(radius2, glm::dot(d, d));
+        }
+        sphereRadius = std::sqrt(radius2);
+    }
 
-    /*  Functions    */
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -105,7 +222,7 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -133,7 +250,33 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        // unbound, so that later element buffer binds can't change the VAO
+        GLState::bindVertexArray(0);
+    }
+
+    // point the per-instance attributes of the VAO to the InstanceData array at 'offset' in 'instanceBuffer',
+    // a matrix attribute takes one location per column, and advances once per instance (divisor 1)
+    void setupInstanceAttributes(unsigned int instanceBuffer, GLintptr offset)
+    {
+        GLState::bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // instance model matrix
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(5 + i);
+            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, Model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + i, 1);
+        }
+        // instance normal matrix
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            glEnableVertexAttribArray(9 + i);
+            glVertexAttribPointer(9 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, NormalMatrix) + i * sizeof(glm::vec3)));
+            glVertexAttribDivisor(9 + i, 1);
+        }
+        GLState::bindVertexArray(0);
+        instanceVBO = instanceBuffer;
+        instanceOffset = offset;
     }
 };
 #endif
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include <assimp/postprocess.h>
 
 #include <mesh.h>
+#include <job_system.h>
+#include <occlusion_culler.h>
+#include <stream_buffer.h>
 #include <shader.h>
 
 #include <string>
@@ -19,10 +22,12 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+void TextureFromImage(unsigned int textureID, unsigned char *data, int width, int height, int nrComponents, const char *path);
 
 class Model
 {
@@ -47,8 +52,106 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws 'count' copies of the model, one per model matrix, with one draw call per mesh,
+    // 'shader' must be an instanced variant that reads the model and normal matrices from vertex attributes
+    void DrawInstanced(Shader shader, const glm::mat4* modelMatrices, unsigned int count)
+    {
+        if (count == 0)
+            return;
+
+        uploadInstanceData(modelMatrices, count);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instanceStream->ID, instanceOffset, count);
+    }
+
+    void DrawInstanced(Shader shader, const vector<glm::mat4> &modelMatrices)
+    {
+        DrawInstanced(shader, modelMatrices.data(), modelMatrices.size());
+    }
+
+    // adds the meshes of the model to 'queue', 'setUniforms' sets the uniforms of the object (e.g. its model matrix)
+    // and 'depth' is the distance of the object to the camera; 'model' places the bounding spheres of the meshes
+    // in the world, so that the queue can cull the meshes that are outside of the view frustum;
+    // with an 'occlusionCuller', the meshes are also tested against the depth of the opaque pass
+    void Submit(RenderQueue &queue, Shader &shader, RenderQueue::Pass pass, float depth, const glm::mat4 &model,
+                const std::function<void()> &setUniforms, OcclusionCuller* occlusionCuller = nullptr)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            RenderQueue::Draw draw = meshes[i].MakeDraw(shader, model, setUniforms);
+            // the meshes outside of the frustum are not tracked, so the culler knows when they come back into view
+            if (occlusionCuller && !queue.isCulled(draw))
+            {
+                OcclusionCuller::Visibility visibility = occlusionCuller->track(&meshes[i], model, meshes[i].aabbMin, meshes[i].aabbMax);
+                if (visibility.skip)
+                    continue;
+                draw.conditionQuery = visibility.conditionQuery;
+            }
+            queue.submit(pass, depth, draw);
+        }
+    }
+
+    // instanced version of Submit, the model matrices are uploaded right away,
+    // so the model can only be submitted instanced once per execution of the queue
+    void SubmitInstanced(RenderQueue &queue, Shader &shader, RenderQueue::Pass pass, float depth,
+                         const glm::mat4* modelMatrices, unsigned int count, const std::function<void()> &setUniforms,
+                         OcclusionCuller* occlusionCuller = nullptr)
+    {
+        if (count == 0)
+            return;
+
+        uploadInstanceData(modelMatrices, count);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            RenderQueue::Draw draw = meshes[i].MakeInstancedDraw(shader, instanceStream->ID, instanceOffset, modelMatrices, count, setUniforms);
+            // not tracked outside of the frustum, see Submit
+            if (occlusionCuller && !queue.isCulled(draw))
+            {
+                // world space box around the sphere that holds all the instances
+                glm::vec3 center(draw.bounds[0], draw.bounds[1], draw.bounds[2]);
+                glm::vec3 extent(draw.bounds[3]);
+                OcclusionCuller::Visibility visibility = occlusionCuller->track(&meshes[i], glm::mat4(1.0f), center - extent, center + extent);
+                if (visibility.skip)
+                    continue;
+                draw.conditionQuery = visibility.conditionQuery;
+            }
+            queue.submit(pass, depth, draw);
+        }
+    }
+
 private:
+    // textures created by loadMaterialTextures, their image is loaded at the end of loadModel
+    struct PendingTexture {
+        unsigned int id;
+        string path;
+    };
+    std::vector<PendingTexture> pendingTextures;
+
+    /*  Instancing data  */
+    std::unique_ptr<StreamBuffer> instanceStream;
+    GLintptr instanceOffset = 0;
+
     /*  Functions   */
+    // writes the model and normal matrices of 'count' instances to the next region of the instance stream,
+    // the draws of the previous frames keep reading their own regions (call it at most once per frame and model)
+    void uploadInstanceData(const glm::mat4* modelMatrices, unsigned int count)
+    {
+        GLsizeiptr size = count * sizeof(InstanceData);
+        if (!instanceStream || instanceStream->getRegionSize() < size)
+            instanceStream.reset(new StreamBuffer(size));
+
+        instanceStream->beginFrame();
+        StreamBuffer::Allocation allocation = instanceStream->allocate(size, sizeof(float));
+        InstanceData* instances = (InstanceData*) allocation.pointer;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            instances[i].Model = modelMatrices[i];
+            instances[i].NormalMatrix = glm::mat3(glm::inverse(glm::transpose(modelMatrices[i])));
+        }
+        instanceStream->commit(allocation);
+        instanceOffset = allocation.offset;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
@@ -66,6 +169,29 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        loadPendingTextures();
+    }
+
+    // decodes the image files of the textures created by processNode in parallel on the job system,
+    // then uploads them on this thread, which owns the GL context
+    void loadPendingTextures()
+    {
+        struct Image {
+            unsigned char *data = nullptr;
+            int width = 0, height = 0, nrComponents = 0;
+        };
+        std::vector<Image> images(pendingTextures.size());
+        JobSystem::instance().parallelFor(0, (unsigned int) pendingTextures.size(), 1, [&](unsigned int begin, unsigned int end){
+            for (unsigned int i = begin; i < end; i++)
+            {
+                string filename = directory + '/' + pendingTextures[i].path;
+                images[i].data = stbi_load(filename.c_str(), &images[i].width, &images[i].height, &images[i].nrComponents, 0);
+            }
+        });
+        for (unsigned int i = 0; i < pendingTextures.size(); i++)
+            TextureFromImage(pendingTextures[i].id, images[i].data, images[i].width, images[i].height,
+                             images[i].nrComponents, pendingTextures[i].path.c_str());
+        pendingTextures.clear();
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -188,9 +314,10 @@ private:
                 }
             }
             if(!skip)
-            {   // if texture hasn't been loaded already, load it
+            {   // if texture hasn't been loaded already, create it now and load its image with the others (see loadPendingTextures)
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                glGenTextures(1, &texture.id);
+                pendingTextures.push_back({texture.id, str.C_Str()});
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -212,6 +339,14 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 
     int width, height, nrComponents;
     unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    TextureFromImage(textureID, data, width, height, nrComponents, path);
+
+    return textureID;
+}
+
+// uploads the decoded image 'data' to 'textureID' and frees it, 'path' is only used in the error message
+void TextureFromImage(unsigned int textureID, unsigned char *data, int width, int height, int nrComponents, const char *path)
+{
     if (data)
     {
         GLenum format;
@@ -222,7 +357,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -238,7 +373,5 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         std::cout << "Texture failed to load at path: " << path << std::endl;
         stbi_image_free(data);
     }
-
-    return textureID;
 }
 #endif
\ No newline at end of file
@@ -7,14 +7,8 @@ in VS_OUT {
    vec2 textCoord;
 } fs_in;
 
-// light uniform variables
-uniform vec3 ambientLightColor;
-uniform vec3 lightColor;
-
-// attenuation
-uniform float attenuationC0;
-uniform float attenuationC1;
-uniform float attenuationC2;
+// light and attenuation uniform variables, FrameUniforms block
+#include "frame_uniforms.glsl"
 
 // material properties
 uniform float ambientOcclusionMix;
@@ -48,23 +42,23 @@ void main()
 
 
    // ambient component
-   vec3 ambient = ambientLightColor * color;
+   vec3 ambient = ambientLightColor.rgb * color;
 
    // diffuse component
    // L: vertex to light vector
    vec3 L_eye = normalize(fs_in.Light_eye - fs_in.Pos_eye).xyz;
    float diffuseModulation = max(dot(fs_in.N_eye, L_eye), 0.0);
-   vec3 diffuse = lightColor * diffuseModulation * color;
+   vec3 diffuse = lightColors[0].rgb * diffuseModulation * color;
 
    // specular component
    // R: incident light (-L) reflection vector, you can also use the reflect() function
    vec3 R_eye =  -L_eye - 2 * dot(-L_eye, fs_in.N_eye) * fs_in.N_eye;
    float specModulation = pow(max(dot(R_eye, normalize(-fs_in.Pos_eye)), 0.0), specularExponent);
-   vec3 specular = lightColor * specModulation;
+   vec3 specular = lightColors[0].rgb * specModulation;
 
    // attenuation
    float dist = length(fs_in.Pos_eye - fs_in.Light_eye);
-   float attenuation =  1.0 / (attenuationC0 + attenuationC1 * dist + attenuationC2 * dist * dist);
+   float attenuation =  1.0 / (lightAttenuation.x + lightAttenuation.y * dist + lightAttenuation.z * dist * dist);
 
    // TODO Exercise 9.4 modulate the color using the interpolated ambient occlusion value
    FragColor = vec4((ambient + (diffuse + specular) * attenuation) , 1.0);
@@ -13,13 +13,13 @@ out VS_OUT {
 } vs_out;
 
 // transformations
-uniform mat4 projection; // camera projection matrix
-uniform mat4 view;  // represents the world in the eye coord space
 uniform mat4 model; // represents model in the world coord space
 uniform mat4 invTranspMV; // inverse of the transpose of (view * model) (used to multiply vectors if there is non-uniform scaling)
 
-// light uniform variables
-uniform vec3 lightPosition;
+// FrameUniforms block
+#include "frame_uniforms.glsl"
+// gl_Position must match between the depth pre-pass and the shaded pass
+#include "invariant_position.glsl"
 
 
 void main() {
@@ -28,7 +28,7 @@ void main() {
    // normal in eye space (for light computation in eye space)
    vec3 N_eye = normalize((invTranspMV * vec4(normal, 0.0)).xyz);
    // light in eye space
-   vec4 Light_eye = view * vec4(lightPosition, 1.0);
+   vec4 Light_eye = view * vec4(lightPositions[0].xyz, 1.0);
 
    // final vertex transform (for opengl rendering)
    gl_Position = projection * Pos_eye;
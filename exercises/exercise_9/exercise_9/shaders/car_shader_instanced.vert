@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 textCoord;
+layout (location = 3) in vec3 tangent;
+layout (location = 4) in vec3 bitangent;
+// per-instance attributes (see InstanceData in mesh.h)
+layout (location = 5) in mat4 model; // represents model in the world coord space
+layout (location = 9) in mat3 normalMatrix; // inverse of the transpose of model (used to multiply vectors if there is non-uniform scaling)
+
+out VS_OUT {
+   vec3 Pos_eye;
+   vec3 N_eye;
+   vec3 Light_eye;
+   vec2 textCoord;
+} vs_out;
+
+// FrameUniforms block
+#include "frame_uniforms.glsl"
+// gl_Position must match between the depth pre-pass and the shaded pass
+#include "invariant_position.glsl"
+
+
+void main() {
+   // vertex in eye space (for light computation in eye space)
+   vec4 Pos_eye = view * model * vec4(vertex, 1.0);
+   // normal in eye space (for light computation in eye space)
+   // the view matrix has no scaling, so the rotation part of it can be applied to normals directly
+   vec3 N_eye = normalize(mat3(view) * normalMatrix * normal);
+   // light in eye space
+   vec4 Light_eye = view * vec4(lightPositions[0].xyz, 1.0);
+
+   // final vertex transform (for opengl rendering)
+   gl_Position = projection * Pos_eye;
+
+   // out info
+   vs_out.Pos_eye = Pos_eye.xyz;
+   vs_out.N_eye = N_eye;
+   vs_out.Light_eye = Light_eye.xyz;
+   vs_out.textCoord = textCoord;
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 330 core
+
+// color writes are off during the depth pre-pass, only the depth of the fragments is written
+void main() {
+}
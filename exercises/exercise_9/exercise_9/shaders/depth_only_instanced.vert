@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 vertex;
+// per-instance attributes (see InstanceData in mesh.h)
+layout (location = 5) in mat4 model; // represents model in the world coord space
+
+// FrameUniforms block
+#include "frame_uniforms.glsl"
+// gl_Position must match between the depth pre-pass and the shaded pass
+#include "invariant_position.glsl"
+
+void main() {
+   vec4 Pos_eye = view * model * vec4(vertex, 1.0);
+   gl_Position = projection * Pos_eye;
+}
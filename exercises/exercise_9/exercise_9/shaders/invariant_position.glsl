@@ -0,0 +1,4 @@
+// the depth pre-pass (depth_only.vert, depth_only_instanced.vert) writes the depth that the shaded pass then tests
+// with GL_EQUAL, so both must get exactly the same depth: every vertex shader of the scene includes this file and
+// computes gl_Position with the same expression, projection * (view * model * vertex)
+invariant gl_Position;
@@ -0,0 +1,510 @@
+//
+// Screenshots (PNG) and video capture (Y4M) of the window, read back asynchronously and encoded on a thread.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_FRAME_CAPTURE_H
+#define ITU_GRAPHICS_PROGRAMMING_FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <profiler.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Call captureFrame() once per frame, after the frame is rendered and before the buffers are swapped.
+// While a screenshot is requested or a video is recorded, the back buffer is copied with glReadPixels into one of
+// RING_SIZE pixel buffer objects. The copy is queued on the GPU and a fence is inserted after it; the buffer is only
+// mapped when its fence has signaled, a frame or two later, so the CPU never waits for the rendering to finish.
+// The mapped pixels are copied to a frame that is queued for the encoder thread, which writes the files.
+// When the encoder (or the disk) can't keep up with the recording, the frames that don't fit in the queue are
+// dropped, or the render loop waits for the encoder, depending on 'dropPolicy'. Screenshots are never dropped.
+class FrameCapture
+{
+public:
+    static const unsigned int RING_SIZE = 3;
+
+    enum DropPolicy { DROP_FRAMES, WAIT_FOR_ENCODER };
+
+    DropPolicy dropPolicy = DROP_FRAMES;
+    // frames waiting for the encoder, before frames are dropped (or the render loop waits)
+    unsigned int maxQueuedFrames = 8;
+
+    // frames of the current (or last) recording
+    unsigned int recordedFrames = 0;
+    unsigned int droppedFrames = 0;
+
+    FrameCapture()
+    {
+        glGenBuffers(RING_SIZE, pbos);
+        // started last, once all the members are initialized
+        encoder = std::thread(&FrameCapture::encodeLoop, this);
+    }
+
+    ~FrameCapture()
+    {
+        // read back and encode what is still in flight
+        while (pendingCount > 0)
+            collect(true);
+        stopRecording();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        queueChanged.notify_all();
+        encoder.join();
+        glDeleteBuffers(RING_SIZE, pbos);
+    }
+
+    // save the next frame to 'path' as a PNG image
+    void screenshot(const std::string &path)
+    {
+        screenshotPath = path;
+    }
+
+    // save the next frames to 'path' as a Y4M video (uncompressed YUV 4:2:0, which ffmpeg and most players read),
+    // 'fps' is the frame rate written in the file, it should match the frame rate of the render loop
+    void startRecording(const std::string &path, unsigned int fps)
+    {
+        stopRecording();
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back();
+        Frame &open = queue.back();
+        open.kind = Frame::OPEN_VIDEO;
+        open.path = path;
+        open.fps = fps;
+        recording = true;
+        recordedFrames = droppedFrames = 0;
+        videoWidth = videoHeight = 0;
+        queueChanged.notify_one();
+    }
+
+    void stopRecording()
+    {
+        if (!recording)
+            return;
+        recording = false;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back();
+        queue.back().kind = Frame::CLOSE_VIDEO;
+        queueChanged.notify_one();
+    }
+
+    bool isRecording() const { return recording; }
+
+    // frames waiting for the encoder
+    unsigned int queuedFrames()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (unsigned int) queue.size();
+    }
+
+    // reads back the window framebuffer (width x height pixels) if a screenshot or a video frame is due,
+    // and passes the frames read back in previous calls to the encoder
+    void captureFrame(int width, int height)
+    {
+        PROFILE_SCOPE("FrameCapture::captureFrame");
+        collect(false);
+
+        bool takeScreenshot = !screenshotPath.empty();
+        if (!takeScreenshot && !recording)
+            return;
+
+        bool recordFrame = recording;
+        if (recordFrame && videoWidth == 0)
+        {
+            videoWidth = width;
+            videoHeight = height;
+        }
+        if (recordFrame && (width != videoWidth || height != videoHeight))
+        {
+            std::cout << "ERROR::FRAME_CAPTURE::SIZE_CHANGED the video is " << videoWidth << "x" << videoHeight
+                      << ", the frame is skipped" << std::endl;
+            recordFrame = false;
+        }
+        if (recordFrame && !takeScreenshot && !makeRoom())
+        {
+            droppedFrames++;
+            return;
+        }
+        if (!recordFrame && !takeScreenshot)
+            return;
+
+        // the ring is full, the oldest read back has to complete
+        if (pendingCount == RING_SIZE)
+            collect(true);
+
+        Slot &slot = slots[(first + pendingCount) % RING_SIZE];
+        GLuint pbo = pbos[(first + pendingCount) % RING_SIZE];
+        slot.width = width;
+        slot.height = height;
+        slot.video = recordFrame;
+        slot.screenshotPath = screenshotPath;
+        screenshotPath.clear();
+        if (recordFrame)
+            recordedFrames++;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        GLsizeiptr size = (GLsizeiptr) width * height * 4;
+        if (slot.capacity < size)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.capacity = size;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        // with a pack buffer bound, the last argument is an offset in the buffer and the call returns immediately
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pendingCount++;
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+private:
+    // a read back in flight
+    struct Slot {
+        GLsync fence = 0;
+        GLsizeiptr capacity = 0;
+        int width = 0, height = 0;
+        bool video = false;
+        std::string screenshotPath;
+    };
+
+    // work for the encoder thread, the pixels are bottom-up RGBA rows, as returned by glReadPixels
+    struct Frame {
+        enum Kind { SCREENSHOT, VIDEO_FRAME, OPEN_VIDEO, CLOSE_VIDEO };
+        Kind kind = VIDEO_FRAME;
+        std::string path;
+        int width = 0, height = 0;
+        unsigned int fps = 0; // OPEN_VIDEO only
+        std::vector<unsigned char> pixels;
+    };
+
+    GLuint pbos[RING_SIZE];
+    Slot slots[RING_SIZE];
+    unsigned int first = 0, pendingCount = 0;
+
+    std::string screenshotPath;
+    bool recording = false;
+    int videoWidth = 0, videoHeight = 0;
+
+    // shared with the encoder thread
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Frame> queue;
+    std::vector<std::vector<unsigned char>> freePixels; // pixel buffers of encoded frames, reused
+    bool quit = false;
+    std::thread encoder;
+
+    // the encoder thread only
+    std::FILE* video = nullptr;
+
+    // true if a new video frame fits in the encoder queue
+    bool makeRoom()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (dropPolicy == WAIT_FOR_ENCODER)
+            queueChanged.wait(lock, [this]() { return queue.size() < maxQueuedFrames; });
+        return queue.size() < maxQueuedFrames;
+    }
+
+    // queues the read backs that are complete for the encoder, in order; with 'wait', waits for the oldest one
+    void collect(bool wait)
+    {
+        while (pendingCount > 0)
+        {
+            Slot &slot = slots[first];
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED && !wait)
+                return;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            wait = false;
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            size_t size = (size_t) slot.width * slot.height * 4;
+            std::vector<unsigned char> pixels = takePixelBuffer();
+            pixels.resize(size);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[first]);
+            void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+            if (mapped)
+            {
+                std::memcpy(pixels.data(), mapped, size);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            first = (first + 1) % RING_SIZE;
+            pendingCount--;
+            if (mapped)
+                push(slot, std::move(pixels));
+        }
+    }
+
+    void push(const Slot &slot, std::vector<unsigned char> pixels)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!slot.screenshotPath.empty())
+        {
+            queue.emplace_back();
+            Frame &frame = queue.back();
+            frame.kind = Frame::SCREENSHOT;
+            frame.path = slot.screenshotPath;
+            frame.width = slot.width;
+            frame.height = slot.height;
+            frame.pixels = slot.video ? pixels : std::move(pixels);
+        }
+        if (slot.video)
+        {
+            queue.emplace_back();
+            Frame &frame = queue.back();
+            frame.kind = Frame::VIDEO_FRAME;
+            frame.width = slot.width;
+            frame.height = slot.height;
+            frame.pixels = std::move(pixels);
+        }
+        queueChanged.notify_all();
+    }
+
+    std::vector<unsigned char> takePixelBuffer()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freePixels.empty())
+            return std::vector<unsigned char>();
+        std::vector<unsigned char> pixels = std::move(freePixels.back());
+        freePixels.pop_back();
+        return pixels;
+    }
+
+    void encodeLoop()
+    {
+        PROFILE_THREAD("frame capture encoder");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            queueChanged.wait(lock, [this]() { return quit || !queue.empty(); });
+            if (queue.empty())
+                break;
+            Frame frame = std::move(queue.front());
+            queue.pop_front();
+            // the render loop may be waiting for room in the queue
+            queueChanged.notify_all();
+
+            lock.unlock();
+            switch (frame.kind)
+            {
+                case Frame::SCREENSHOT:
+                {
+                    PROFILE_SCOPE("FrameCapture::writePng");
+                    writePng(frame);
+                    break;
+                }
+                case Frame::VIDEO_FRAME:
+                {
+                    PROFILE_SCOPE("FrameCapture::writeVideoFrame");
+                    writeVideoFrame(frame);
+                    break;
+                }
+                case Frame::OPEN_VIDEO:
+                    openVideo(frame.path);
+                    videoFps = (int) frame.fps;
+                    break;
+                case Frame::CLOSE_VIDEO:
+                    if (video)
+                        std::fclose(video);
+                    video = nullptr;
+                    videoHeaderWritten = false;
+                    break;
+            }
+            lock.lock();
+            if (!frame.pixels.empty() && freePixels.size() < RING_SIZE + 2)
+                freePixels.push_back(std::move(frame.pixels));
+        }
+        if (video)
+            std::fclose(video);
+    }
+
+    /*  Y4M  */
+    int videoFps = 30;
+    bool videoHeaderWritten = false;
+    std::vector<unsigned char> yuv;
+
+    void openVideo(const std::string &path)
+    {
+        video = std::fopen(path.c_str(), "wb");
+        videoHeaderWritten = false;
+        if (!video)
+            std::cout << "ERROR::FRAME_CAPTURE::FILE_NOT_OPENED " << path << std::endl;
+    }
+
+    // YUV 4:2:0 with full range BT.601 coefficients (the 'C420jpeg' colorspace of Y4M)
+    void writeVideoFrame(const Frame &frame)
+    {
+        if (!video)
+            return;
+        int w = frame.width, h = frame.height;
+        int cw = (w + 1) / 2, ch = (h + 1) / 2;
+        if (!videoHeaderWritten)
+        {
+            std::fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, videoFps);
+            videoHeaderWritten = true;
+        }
+        yuv.resize((size_t) w * h + 2 * (size_t) cw * ch);
+        unsigned char* Y = yuv.data();
+        unsigned char* U = Y + (size_t) w * h;
+        unsigned char* V = U + (size_t) cw * ch;
+        const unsigned char* rgba = frame.pixels.data();
+        // rows are flipped, glReadPixels returns the bottom row first
+        for (int y = 0; y < h; y++)
+        {
+            const unsigned char* row = rgba + (size_t) (h - 1 - y) * w * 4;
+            for (int x = 0; x < w; x++)
+            {
+                const unsigned char* p = row + x * 4;
+                Y[(size_t) y * w + x] = (unsigned char) ((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+            }
+        }
+        for (int y = 0; y < ch; y++)
+        {
+            for (int x = 0; x < cw; x++)
+            {
+                // average of the 2x2 block, clamped at the last row and column
+                int r = 0, g = 0, b = 0;
+                for (int dy = 0; dy < 2; dy++)
+                    for (int dx = 0; dx < 2; dx++)
+                    {
+                        int sx = std::min(2 * x + dx, w - 1), sy = std::min(2 * y + dy, h - 1);
+                        const unsigned char* p = rgba + ((size_t) (h - 1 - sy) * w + sx) * 4;
+                        r += p[0]; g += p[1]; b += p[2];
+                    }
+                U[(size_t) y * cw + x] = clampByte(128 + ((-43 * r - 85 * g + 128 * b + 512) >> 10));
+                V[(size_t) y * cw + x] = clampByte(128 + ((128 * r - 107 * g - 21 * b + 512) >> 10));
+            }
+        }
+        std::fputs("FRAME\n", video);
+        std::fwrite(yuv.data(), 1, yuv.size(), video);
+    }
+
+    static unsigned char clampByte(int v)
+    {
+        return (unsigned char) (v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+
+    /*  PNG  */
+    // RGB image, compressed with 'stored' deflate blocks: larger files, but no compression library
+    // and no time spent compressing
+    static void writePng(const Frame &frame)
+    {
+        std::FILE* file = std::fopen(frame.path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::FRAME_CAPTURE::FILE_NOT_OPENED " << frame.path << std::endl;
+            return;
+        }
+        int w = frame.width, h = frame.height;
+
+        // filter byte (none) and RGB pixels of each row, top row first
+        size_t rowSize = 1 + (size_t) w * 3;
+        std::vector<unsigned char> raw(rowSize * h);
+        for (int y = 0; y < h; y++)
+        {
+            unsigned char* out = &raw[rowSize * y];
+            const unsigned char* in = frame.pixels.data() + (size_t) (h - 1 - y) * w * 4;
+            *out++ = 0;
+            for (int x = 0; x < w; x++, in += 4)
+            {
+                *out++ = in[0];
+                *out++ = in[1];
+                *out++ = in[2];
+            }
+        }
+
+        // zlib stream: header, stored blocks of up to 65535 bytes, adler32 of the raw data
+        std::vector<unsigned char> zlib = {0x78, 0x01};
+        size_t blocks = raw.empty() ? 1 : (raw.size() + 65534) / 65535;
+        zlib.reserve(2 + raw.size() + blocks * 5 + 4);
+        for (size_t i = 0; i < blocks; i++)
+        {
+            size_t start = i * 65535;
+            size_t length = std::min<size_t>(65535, raw.size() - start);
+            zlib.push_back(i + 1 == blocks ? 1 : 0);
+            zlib.push_back(length & 0xff);
+            zlib.push_back(length >> 8);
+            zlib.push_back(~length & 0xff);
+            zlib.push_back((~length >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + start, raw.begin() + start + length);
+        }
+        uint32_t a = 1, b = 0;
+        for (unsigned char byte : raw)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        putBigEndian(zlib, (b << 16) | a);
+
+        std::vector<unsigned char> header;
+        putBigEndian(header, w);
+        putBigEndian(header, h);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bits per channel, RGB, deflate, adaptive filter, no interlace
+
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        std::fwrite(signature, 1, 8, file);
+        writeChunk(file, "IHDR", header);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", std::vector<unsigned char>());
+        std::fclose(file);
+    }
+
+    static void putBigEndian(std::vector<unsigned char> &out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back((value >> shift) & 0xff);
+    }
+
+    static void writeChunk(std::FILE* file, const char* type, const std::vector<unsigned char> &data)
+    {
+        std::vector<unsigned char> chunk;
+        putBigEndian(chunk, (uint32_t) data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        // the CRC covers the type and the data
+        putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+        std::fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    static uint32_t crc32(const unsigned char* data, size_t size)
+    {
+        static uint32_t table[256] = {0};
+        static bool tableReady = false;
+        if (!tableReady)
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            tableReady = true;
+        }
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_FRAME_CAPTURE_H
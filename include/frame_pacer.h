@@ -0,0 +1,197 @@
+//
+// Frame pacer: holds the frame rate of a render loop without burning a core in a busy wait.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_FRAME_PACER_H
+#define ITU_GRAPHICS_PROGRAMMING_FRAME_PACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// beginFrame() at the start of every frame, endFrame() after the buffers are swapped:
+//   CAPPED    endFrame() waits for the next frame deadline; it sleeps while the deadline is further away than the
+//             sleeps have been overshooting (their mean plus one standard deviation), and only spins the rest
+//   VSYNC     endFrame() doesn't wait, the swap does; the caller sets glfwSwapInterval(1) (see swapInterval())
+//   UNCAPPED  endFrame() doesn't wait
+// The deadlines advance by the frame interval, so an occasional late wake up doesn't slow down the average rate;
+// a frame that misses its deadline by more than an interval starts a new schedule instead of rushing to catch up.
+// With setFixedStep(), fixedSteps() tells how many simulation steps of that length the last frame covered, which
+// keeps the simulation speed independent of the frame rate.
+class FramePacer
+{
+public:
+    enum Mode {CAPPED, VSYNC, UNCAPPED};
+
+    // frames kept for the statistics
+    static const unsigned int HISTORY = 120;
+
+    struct Stats {
+        float frameMs = 0.0f;      // average frame time
+        float jitterMs = 0.0f;     // standard deviation of the frame time
+        float maxFrameMs = 0.0f;
+        float sleepErrorMs = 0.0f; // mean oversleep of a 1 ms sleep, and its standard deviation
+        float sleepErrorDeviationMs = 0.0f;
+        float spinMs = 0.0f;       // average time spun per frame, after sleeping
+        unsigned long long frames = 0;
+        unsigned long long missedFrames = 0; // CAPPED frames that ended after their deadline
+    };
+
+    explicit FramePacer(float interval = 1.0f / 60.0f, Mode mode = CAPPED)
+            : interval(interval), mode(mode), start(Clock::now()), frameStart(start), nextFrame(start) {}
+
+    void setMode(Mode newMode) { mode = newMode; }
+    Mode getMode() const { return mode; }
+    // the swap interval that goes with the mode, for glfwSwapInterval
+    int swapInterval() const { return mode == VSYNC ? 1 : 0; }
+
+    void setInterval(float seconds) { interval = seconds; }
+    float getInterval() const { return interval; }
+
+    // simulation step of fixedSteps(), and the most steps run in one frame (a long stall drops the rest)
+    void setFixedStep(float seconds, unsigned int maxSteps = 5)
+    {
+        fixedStep = seconds;
+        maxFixedSteps = std::max(1u, maxSteps);
+        accumulator = 0.0;
+    }
+
+    // starts a frame, returns the seconds since the start of the previous one
+    float beginFrame()
+    {
+        Clock::time_point now = Clock::now();
+        double delta = frames == 0 ? 0.0 : seconds(now - frameStart);
+        if (frames == 0)
+            nextFrame = now;
+        frameStart = now;
+
+        if (frames > 0)
+        {
+            frameTimes[(frames - 1) % HISTORY] = (float) delta;
+            accumulator += delta;
+        }
+        frames++;
+        return (float) delta;
+    }
+
+    // waits for the deadline of the next frame (CAPPED mode only)
+    void endFrame()
+    {
+        Clock::time_point now = Clock::now();
+        if (mode != CAPPED)
+        {
+            nextFrame = now;
+            return;
+        }
+        nextFrame += toDuration(interval);
+        if (now > nextFrame)
+        {
+            missedFrames++;
+            if (seconds(now - nextFrame) > interval)
+                nextFrame = now;
+        }
+        waitUntil(nextFrame);
+    }
+
+    // number of simulation steps to run this frame, 0 without a fixed step
+    unsigned int fixedSteps()
+    {
+        if (fixedStep <= 0.0f)
+            return 0;
+        unsigned int steps = (unsigned int) (accumulator / fixedStep);
+        if (steps > maxFixedSteps)
+        {
+            steps = maxFixedSteps;
+            accumulator = 0.0;
+        }
+        else
+            accumulator -= steps * (double) fixedStep;
+        return steps;
+    }
+
+    // fraction of a fixed step that fixedSteps() left over, to interpolate between the last two steps
+    float interpolation() const { return fixedStep > 0.0f ? (float) (accumulator / fixedStep) : 0.0f; }
+
+    // seconds since the pacer was created, at the start of the current frame
+    float getTime() const { return (float) seconds(frameStart - start); }
+
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.frames = frames;
+        stats.missedFrames = missedFrames;
+        unsigned int count = (unsigned int) std::min<unsigned long long>(frames > 0 ? frames - 1 : 0, HISTORY);
+        if (count > 0)
+        {
+            double sum = 0.0, sumSquares = 0.0, max = 0.0;
+            for (unsigned int i = 0; i < count; i++)
+            {
+                sum += frameTimes[i];
+                sumSquares += (double) frameTimes[i] * frameTimes[i];
+                max = std::max(max, (double) frameTimes[i]);
+            }
+            double mean = sum / count;
+            stats.frameMs = (float) (mean * 1000.0);
+            stats.jitterMs = (float) (std::sqrt(std::max(0.0, sumSquares / count - mean * mean)) * 1000.0);
+            stats.maxFrameMs = (float) (max * 1000.0);
+        }
+        stats.sleepErrorMs = (float) ((sleepMean - 0.001) * 1000.0);
+        stats.sleepErrorDeviationMs = (float) (sleepDeviation() * 1000.0);
+        stats.spinMs = frames > 0 ? (float) (spinTotal / frames * 1000.0) : 0.0f;
+        return stats;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    float interval;
+    Mode mode;
+    Clock::time_point start, frameStart, nextFrame;
+    unsigned long long frames = 0, missedFrames = 0;
+    float frameTimes[HISTORY] = {};
+
+    float fixedStep = 0.0f;
+    unsigned int maxFixedSteps = 5;
+    double accumulator = 0.0;
+
+    // running mean and variance (Welford) of the duration of a 1 ms sleep, starting from a pessimistic guess;
+    // the count is capped so that the estimate keeps following the system timer
+    double sleepMean = 0.005, sleepM2 = 0.0;
+    unsigned int sleepCount = 1;
+    double spinTotal = 0.0;
+
+    static double seconds(Clock::duration duration) { return std::chrono::duration<double>(duration).count(); }
+    static Clock::duration toDuration(double seconds)
+    {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    double sleepDeviation() const { return sleepCount > 1 ? std::sqrt(sleepM2 / (sleepCount - 1)) : 0.0; }
+
+    void waitUntil(Clock::time_point deadline)
+    {
+        // coarse: 1 ms sleeps while the deadline is further away than a sleep may take
+        while (seconds(deadline - Clock::now()) > sleepMean + sleepDeviation())
+        {
+            Clock::time_point sleepStart = Clock::now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double slept = seconds(Clock::now() - sleepStart);
+
+            if (sleepCount < 1000)
+                sleepCount++;
+            else
+                sleepM2 -= sleepM2 / sleepCount;
+            double delta = slept - sleepMean;
+            sleepMean += delta / sleepCount;
+            sleepM2 += delta * (slept - sleepMean);
+        }
+        // fine: spin the last fraction of a millisecond
+        Clock::time_point spinStart = Clock::now();
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+        spinTotal += seconds(Clock::now() - spinStart);
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_FRAME_PACER_H
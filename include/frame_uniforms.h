@@ -0,0 +1,38 @@
+//
+// Per-frame camera and lighting state, uploaded once per frame to a uniform buffer.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_FRAME_UNIFORMS_H
+#define ITU_GRAPHICS_PROGRAMMING_FRAME_UNIFORMS_H
+
+#include <glm/glm.hpp>
+
+// binding point of the FrameUniforms block in every program
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
+const unsigned int FRAME_UNIFORMS_MAX_LIGHTS = 4;
+
+// std140 mirror of the GLSL block below, keep both in sync:
+//
+// layout (std140) uniform FrameUniforms {
+//    mat4 projection;
+//    mat4 view;
+//    vec4 camPosition;
+//    vec4 ambientLightColor;
+//    vec4 lightPositions[4];
+//    vec4 lightColors[4];
+//    vec4 lightAttenuation;
+// };
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 camPosition;         // xyz: camera position in world space
+    glm::vec4 ambientLightColor;   // rgb: color * intensity
+    glm::vec4 lightPositions[FRAME_UNIFORMS_MAX_LIGHTS];  // xyz: light position in world space
+    glm::vec4 lightColors[FRAME_UNIFORMS_MAX_LIGHTS];     // rgb: color * intensity
+    glm::vec4 lightAttenuation;    // x, y, z: attenuation c0, c1 and c2, w: number of lights in use
+};
+
+static_assert(sizeof(FrameUniforms) == 2 * 64 + (3 + 2 * FRAME_UNIFORMS_MAX_LIGHTS) * 16,
+              "FrameUniforms must match the std140 layout of the GLSL block");
+
+#endif //ITU_GRAPHICS_PROGRAMMING_FRAME_UNIFORMS_H
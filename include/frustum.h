@@ -0,0 +1,103 @@
+//
+// View frustum and bounding sphere tests used for frustum culling.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_FRUSTUM_H
+#define ITU_GRAPHICS_PROGRAMMING_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ITU_FRUSTUM_SSE
+#endif
+
+// The six planes (left, right, bottom, top, near, far) of a view frustum, in the space of the matrix they were
+// extracted from (world space for projection * view). A plane (a, b, c, d) is normalized and its normal
+// (a, b, c) points inside, so a point p is inside the frustum if dot(plane.xyz, p) + plane.w >= 0 for all planes.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb and Hartmann, the planes are sums and differences of the rows of the (column major) matrix
+    static Frustum fromMatrix(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // bottom
+        frustum.planes[3] = row3 - row1; // top
+        frustum.planes[4] = row3 + row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        for (const glm::vec4 &plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // conservative: a box near a corner of the frustum may pass without intersecting it
+    bool intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const
+    {
+        for (const glm::vec4 &plane : planes) {
+            // the corner furthest along the normal
+            glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// bounding sphere of a sphere with 'center' and 'radius' transformed by 'model' (xyz: center, w: radius),
+// non-uniform scaling is accounted for by scaling the radius with the largest axis scale
+inline glm::vec4 transformSphere(const glm::mat4 &model, const glm::vec3 &center, float radius)
+{
+    float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    return glm::vec4(glm::vec3(model * glm::vec4(center, 1.0f)), radius * scale);
+}
+
+// Tests 'count' spheres against 'frustum', with the spheres stored as separate arrays of x, y, z and radius,
+// sets visible[i] to 1 if sphere i intersects the frustum and to 0 otherwise.
+// With SSE, four spheres are tested per iteration, the arrays must then hold a multiple of 4 elements
+// (the content of the padding does not matter).
+inline void cullSpheres(const Frustum &frustum, const float* x, const float* y, const float* z, const float* r,
+                        unsigned int count, unsigned char* visible)
+{
+    unsigned int i = 0;
+#ifdef ITU_FRUSTUM_SSE
+    for (; i < count; i += 4) {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+        __m128 inside = _mm_cmpeq_ps(cx, cx); // all bits set
+        for (const glm::vec4 &plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                                         _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (unsigned int j = 0; j < 4 && i + j < count; j++)
+            visible[i + j] = (unsigned char) ((mask >> j) & 1);
+    }
+#endif
+    for (; i < count; i++)
+        visible[i] = frustum.intersectsSphere(glm::vec3(x[i], y[i], z[i]), r[i]) ? 1 : 0;
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_FRUSTUM_H
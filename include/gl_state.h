@@ -0,0 +1,141 @@
+//
+// Shadow of the bound program, vertex array and textures, skips the binds that would not change anything.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_GL_STATE_H
+#define ITU_GRAPHICS_PROGRAMMING_GL_STATE_H
+
+#include <glad/glad.h>
+
+// glUseProgram, glBindVertexArray, glActiveTexture and glBindTexture go through these functions, which remember
+// the current binding of the (single) GL context and only call GL when the binding changes. Each function returns
+// true if it issued the GL call. The calls issued and elided are counted per frame (see newFrame()).
+// Code that changes these bindings directly with GL (e.g. a UI library) must be followed by invalidate(),
+// so that the next binds are issued unconditionally.
+namespace GLState {
+
+    const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    // texture targets that are shadowed, binds to other targets are always issued
+    const GLenum TEXTURE_TARGETS[] = {GL_TEXTURE_2D, GL_TEXTURE_BUFFER, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY};
+    const unsigned int TEXTURE_TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+    // 'unknown' never matches a GL name, so the first bind after invalidate() is always issued
+    const GLuint UNKNOWN = ~0u;
+
+    struct Counters {
+        unsigned int issued = 0;
+        unsigned int elided = 0;
+    };
+
+    struct State {
+        GLuint program = UNKNOWN;
+        GLuint vertexArray = UNKNOWN;
+        GLenum activeUnit = UNKNOWN;
+        GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+        Counters frame, lastFrame;
+
+        State() { invalidateTextures(); }
+
+        void invalidateTextures()
+        {
+            for (auto &unit : textures)
+                for (GLuint &texture : unit)
+                    texture = UNKNOWN;
+        }
+    };
+
+    inline State& state(){
+        static State current;
+        return current;
+    }
+
+    // counts a bind, returns 'issued'
+    inline bool count(bool issued){
+        if (issued)
+            state().frame.issued++;
+        else
+            state().frame.elided++;
+        return issued;
+    }
+
+    inline bool useProgram(GLuint program){
+        State &s = state();
+        if (s.program == program)
+            return count(false);
+        glUseProgram(program);
+        s.program = program;
+        return count(true);
+    }
+
+    inline bool bindVertexArray(GLuint vertexArray){
+        State &s = state();
+        if (s.vertexArray == vertexArray)
+            return count(false);
+        glBindVertexArray(vertexArray);
+        s.vertexArray = vertexArray;
+        return count(true);
+    }
+
+    // 'unit' is GL_TEXTURE0 + i, as in glActiveTexture
+    inline bool activeTexture(GLenum unit){
+        State &s = state();
+        if (s.activeUnit == unit)
+            return count(false);
+        glActiveTexture(unit);
+        s.activeUnit = unit;
+        return count(true);
+    }
+
+    // binds 'texture' to 'target' of the active unit
+    inline bool bindTexture(GLenum target, GLuint texture){
+        State &s = state();
+        unsigned int unit = s.activeUnit - GL_TEXTURE0;
+        unsigned int targetIndex = 0;
+        while (targetIndex < TEXTURE_TARGET_COUNT && TEXTURE_TARGETS[targetIndex] != target)
+            targetIndex++;
+        // unknown active unit, or a unit or target that is not shadowed
+        if (unit >= MAX_TEXTURE_UNITS || targetIndex == TEXTURE_TARGET_COUNT) {
+            glBindTexture(target, texture);
+            return count(true);
+        }
+        if (s.textures[unit][targetIndex] == texture)
+            return count(false);
+        glBindTexture(target, texture);
+        s.textures[unit][targetIndex] = texture;
+        return count(true);
+    }
+
+    // binds 'texture' to 'target' of unit GL_TEXTURE0 + 'unit', without changing the active unit if it is bound already
+    inline bool bindTextureUnit(unsigned int unit, GLenum target, GLuint texture){
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS) {
+            for (unsigned int i = 0; i < TEXTURE_TARGET_COUNT; i++) {
+                if (TEXTURE_TARGETS[i] == target && s.textures[unit][i] == texture)
+                    return count(false);
+            }
+        }
+        activeTexture(GL_TEXTURE0 + unit);
+        return bindTexture(target, texture);
+    }
+
+    // forget the shadowed bindings, after they were changed behind our back
+    inline void invalidate(){
+        State &s = state();
+        s.program = s.vertexArray = s.activeUnit = UNKNOWN;
+        s.invalidateTextures();
+    }
+
+    // start counting the binds of a new frame
+    inline void newFrame(){
+        state().lastFrame = state().frame;
+        state().frame = Counters();
+    }
+
+    // binds issued and elided during the last complete frame
+    inline const Counters& lastFrame(){
+        return state().lastFrame;
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_GL_STATE_H
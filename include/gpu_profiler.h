@@ -0,0 +1,234 @@
+//
+// GPU profiler: time of named render passes, from GL_TIMESTAMP queries read a few frames later.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_GPU_PROFILER_H
+#define ITU_GRAPHICS_PROGRAMMING_GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The passes are delimited by beginPass() and endPass() (or a GpuProfiler::Scope), between beginFrame() and
+// endFrame(). Each pass writes a GL_TIMESTAMP query when it begins and another when it ends; unlike GL_TIME_ELAPSED
+// queries, timestamps can be nested and can be used while a GpuTimer is running.
+// The queries of a frame are read FRAME_LATENCY frames later, when the GPU is done with them. If they are still not
+// available then, the frame is dropped rather than waited for. Every pass keeps the average and maximum of its
+// last HISTORY frames, and the timings of every frame can be appended to a CSV file.
+// Needs a current GL context when constructed.
+class GpuProfiler
+{
+public:
+    static const unsigned int FRAME_LATENCY = 3;
+    static const unsigned int MAX_PASSES = 32; // per frame
+    static const unsigned int HISTORY = 120;
+
+    struct PassStats {
+        std::string name;
+        unsigned int depth = 0; // number of enclosing passes
+        float lastMs = 0.0f;
+        float averageMs = 0.0f;
+        float maxMs = 0.0f;
+        // the last HISTORY timings, the frames without the pass count as 0
+        float history[HISTORY] = {};
+    };
+
+    // frames read back and frames dropped because their queries were not available in time
+    unsigned int resolvedFrames = 0;
+    unsigned int droppedFrames = 0;
+
+    // times the enclosing scope as a pass, nothing happens if 'profiler' is nullptr
+    class Scope
+    {
+    public:
+        Scope(GpuProfiler* profiler, const char* name) : profiler(profiler)
+        {
+            if (profiler)
+                profiler->beginPass(name);
+        }
+        ~Scope()
+        {
+            if (profiler)
+                profiler->endPass();
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        GpuProfiler* profiler;
+    };
+
+    GpuProfiler()
+    {
+        glGenQueries(FRAME_LATENCY * MAX_PASSES * 2, &queries[0][0]);
+    }
+
+    ~GpuProfiler()
+    {
+        stopCsv();
+        glDeleteQueries(FRAME_LATENCY * MAX_PASSES * 2, &queries[0][0]);
+    }
+
+    // reads back the frame issued FRAME_LATENCY frames ago, and starts recording the passes of a new frame
+    void beginFrame()
+    {
+        frameIndex++;
+        current = frameIndex % FRAME_LATENCY;
+        Frame &frame = frames[current];
+        if (!frame.passes.empty())
+            resolve(frame);
+        frame.passes.clear();
+        frame.index = frameIndex;
+        open.clear();
+        inFrame = true;
+    }
+
+    void endFrame()
+    {
+        // passes left open are closed here
+        while (!open.empty())
+            endPass();
+        inFrame = false;
+    }
+
+    // 'name' must outlive the profiler (e.g. a string literal)
+    void beginPass(const char* name)
+    {
+        Frame &frame = frames[current];
+        if (!inFrame || frame.passes.size() == MAX_PASSES)
+        {
+            open.push_back(-1);
+            return;
+        }
+        unsigned int i = (unsigned int) frame.passes.size();
+        frame.passes.push_back({name, (unsigned int) open.size()});
+        glQueryCounter(queries[current][i * 2], GL_TIMESTAMP);
+        frame.lastQuery = i * 2;
+        open.push_back((int) i);
+    }
+
+    void endPass()
+    {
+        if (open.empty())
+            return;
+        int i = open.back();
+        open.pop_back();
+        if (i >= 0)
+        {
+            glQueryCounter(queries[current][i * 2 + 1], GL_TIMESTAMP);
+            frames[current].lastQuery = i * 2 + 1;
+        }
+    }
+
+    // statistics of every pass seen so far, in the order they were first seen
+    const std::vector<PassStats>& getPasses() const { return passes; }
+
+    // append the timings of every resolved frame to 'path', one line per pass: frame,pass,depth,ms
+    bool startCsv(const std::string &path)
+    {
+        stopCsv();
+        csv = std::fopen(path.c_str(), "w");
+        if (!csv)
+            return false;
+        std::fputs("frame,pass,depth,ms\n", csv);
+        return true;
+    }
+
+    void stopCsv()
+    {
+        if (csv)
+            std::fclose(csv);
+        csv = nullptr;
+    }
+
+    bool isWritingCsv() const { return csv != nullptr; }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+private:
+    struct FramePass {
+        const char* name;
+        unsigned int depth;
+    };
+
+    struct Frame {
+        unsigned long long index = 0;
+        std::vector<FramePass> passes;
+        unsigned int lastQuery = 0; // the query issued last
+    };
+
+    GLuint queries[FRAME_LATENCY][MAX_PASSES * 2];
+    Frame frames[FRAME_LATENCY];
+    unsigned long long frameIndex = 0;
+    unsigned int current = 0;
+    std::vector<int> open; // passes begun and not ended, -1 for the passes that are not recorded
+    bool inFrame = false;
+
+    std::vector<PassStats> passes;
+    std::FILE* csv = nullptr;
+
+    // 'frame' is the frame that used the queries of the current slot
+    void resolve(const Frame &frame)
+    {
+        GLuint* frameQueries = queries[current];
+        // the queries complete in order, if the last one is available all of them are
+        GLuint available = 0;
+        glGetQueryObjectuiv(frameQueries[frame.lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            droppedFrames++;
+            return;
+        }
+        resolvedFrames++;
+
+        std::vector<float> frameMs(passes.size(), 0.0f);
+        for (unsigned int i = 0; i < frame.passes.size(); i++)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frameQueries[i * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frameQueries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            float ms = end > begin ? (float) ((end - begin) / 1.0e6) : 0.0f;
+
+            unsigned int pass = findPass(frame.passes[i]);
+            frameMs.resize(passes.size(), 0.0f);
+            // a pass that runs several times in a frame adds up
+            frameMs[pass] += ms;
+            if (csv)
+                std::fprintf(csv, "%llu,%s,%u,%.4f\n", frame.index, frame.passes[i].name, frame.passes[i].depth, ms);
+        }
+
+        // resolvedFrames already counts this frame, the first one goes to history[0]
+        unsigned int slot = (resolvedFrames - 1) % HISTORY;
+        for (unsigned int i = 0; i < passes.size(); i++)
+        {
+            PassStats &stats = passes[i];
+            stats.lastMs = frameMs[i];
+            stats.history[slot] = frameMs[i];
+            unsigned int count = std::min(resolvedFrames, HISTORY);
+            float sum = 0.0f, max = 0.0f;
+            for (unsigned int j = 0; j < count; j++)
+            {
+                sum += stats.history[j];
+                max = std::max(max, stats.history[j]);
+            }
+            stats.averageMs = sum / count;
+            stats.maxMs = max;
+        }
+    }
+
+    unsigned int findPass(const FramePass &framePass)
+    {
+        for (unsigned int i = 0; i < passes.size(); i++)
+            if (passes[i].name == framePass.name && passes[i].depth == framePass.depth)
+                return i;
+        passes.emplace_back();
+        passes.back().name = framePass.name;
+        passes.back().depth = framePass.depth;
+        return (unsigned int) passes.size() - 1;
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_GPU_PROFILER_H
@@ -0,0 +1,75 @@
+//
+// GPU timer based on GL_TIME_ELAPSED queries, read without stalling.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_GPU_TIMER_H
+#define ITU_GRAPHICS_PROGRAMMING_GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// Measures the GPU time of the commands between begin() and end(). The result of a query is only read
+// LATENCY frames later, when it is most likely available; a result that is still not available is dropped
+// instead of waited for. Only one timer can be running at a time (GL_TIME_ELAPSED queries can't be nested).
+// Needs a current GL context when constructed.
+class GpuTimer
+{
+public:
+    static const unsigned int LATENCY = 4;
+
+    GpuTimer()
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(LATENCY, queries);
+    }
+
+    void begin()
+    {
+        if (issued[next])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[next], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &nanoseconds);
+                lastMs = (float) (nanoseconds / 1.0e6);
+                // exponential moving average, so that the value is readable in a UI
+                averageMs = samples++ == 0 ? lastMs : averageMs * 0.95f + lastMs * 0.05f;
+            }
+            issued[next] = false;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[next] = true;
+        next = (next + 1) % LATENCY;
+    }
+
+    // forget the average, e.g. when the measured work changes
+    void reset()
+    {
+        samples = 0;
+        averageMs = lastMs = 0.0f;
+    }
+
+    float lastMs = 0.0f;
+    float averageMs = 0.0f;
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+private:
+    unsigned int queries[LATENCY];
+    bool issued[LATENCY] = {false, false, false, false};
+    unsigned int next = 0;
+    unsigned int samples = 0;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_GPU_TIMER_H
@@ -0,0 +1,347 @@
+//
+// Work-stealing job system, shared by the CPU heavy parts of the exercises instead of each spawning threads.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_JOB_SYSTEM_H
+#define ITU_GRAPHICS_PROGRAMMING_JOB_SYSTEM_H
+
+#include <profiler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One worker thread per core (but one), plus the thread that created the system, which takes part in the work
+// while it waits for its jobs (wait() runs jobs until the counter it waits for reaches 0).
+// Each of these threads owns a Chase-Lev deque: it pushes and pops its jobs at the bottom, without locks, and the
+// idle threads steal from the top of the other deques. Jobs submitted by other threads go through a locked queue.
+// Completion is tracked with counters: a job can decrement a counter when it finishes, and a job can wait for a
+// counter to reach 0 before it is scheduled, which expresses dependencies between groups of jobs.
+// The jobs must not block on each other except through wait().
+class JobSystem
+{
+private:
+    struct Job;
+
+public:
+    // number of unfinished jobs of a group; must outlive the jobs that signal it and the jobs that depend on it
+    class Counter
+    {
+    public:
+        bool done() const { return value.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<int> value{0};
+        // jobs waiting for the counter to reach 0
+        std::mutex mutex;
+        std::vector<Job*> dependents;
+    };
+
+    // the system shared by the whole application, created on first use (by the main thread, normally)
+    static JobSystem& instance()
+    {
+        static JobSystem system;
+        return system;
+    }
+
+    explicit JobSystem(unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1)
+    {
+        for (unsigned int i = 0; i <= workerCount; i++)
+            deques.emplace_back(new Deque());
+        // the creating thread owns deque 0
+        current() = {this, 0};
+        for (unsigned int i = 1; i <= workerCount; i++)
+            workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            quit = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+        if (current().system == this)
+            current() = {nullptr, 0};
+    }
+
+    // threads that run jobs, including the creating thread
+    unsigned int threadCount() const { return (unsigned int) deques.size(); }
+
+    // schedule 'function'; 'signal' (optional) is decremented when it has run,
+    // and it is only scheduled once 'dependency' (optional) has reached 0
+    void run(std::function<void()> function, Counter* signal = nullptr, Counter* dependency = nullptr)
+    {
+        Job* job = new Job{std::move(function), signal};
+        if (signal)
+            signal->value.fetch_add(1, std::memory_order_relaxed);
+        if (dependency)
+        {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (!dependency->done())
+            {
+                dependency->dependents.push_back(job);
+                return;
+            }
+        }
+        submit(job);
+    }
+
+    // run jobs until 'counter' reaches 0
+    void wait(Counter &counter)
+    {
+        while (!counter.done())
+        {
+            if (!runOne())
+                std::this_thread::yield();
+        }
+        // the job that signaled the counter may still hold its lock, don't let the caller destroy it before
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+    // calls function(rangeBegin, rangeEnd) over [begin, end) split in ranges of 'grain' elements, in parallel,
+    // and returns when all the ranges are done (the calling thread runs ranges too)
+    template<class Function>
+    void parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const Function &function)
+    {
+        grain = std::max(1u, grain);
+        if (end <= begin)
+            return;
+        if (end - begin <= grain)
+        {
+            function(begin, end);
+            return;
+        }
+        Counter counter;
+        // the first range is kept for the calling thread
+        for (unsigned int rangeBegin = begin + grain; rangeBegin < end; rangeBegin += std::min(grain, end - rangeBegin))
+        {
+            unsigned int rangeEnd = rangeBegin + std::min(grain, end - rangeBegin);
+            run([&function, rangeBegin, rangeEnd]() { function(rangeBegin, rangeEnd); }, &counter);
+        }
+        function(begin, begin + grain);
+        wait(counter);
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        Counter* signal;
+    };
+
+    // Chase-Lev work-stealing deque of fixed capacity ("Correct and Efficient Work-Stealing for Weak Memory
+    // Models", Lê et al. 2013); push and pop are only called by the owner thread, steal by any thread
+    class Deque
+    {
+    public:
+        static const int64_t CAPACITY = 4096;
+
+        // false if the deque is full
+        bool push(Job* job)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= CAPACITY)
+                return false;
+            jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        Job* pop()
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            Job* job = nullptr;
+            if (t <= b)
+            {
+                job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+                if (t == b)
+                {
+                    // last job, race against the thieves
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        job = nullptr;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            }
+            else
+                bottom.store(b + 1, std::memory_order_relaxed);
+            return job;
+        }
+
+        Job* steal()
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return job;
+        }
+
+    private:
+        // top and bottom on their own cache lines, the owner and the thieves write to different ones
+        std::atomic<int64_t> top{0};
+        char topPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> bottom{0};
+        char bottomPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<Job*> jobs[CAPACITY];
+    };
+
+    // the system and deque of the calling thread, if it is one of the threads of a system
+    struct ThreadSlot {
+        JobSystem* system;
+        unsigned int index;
+    };
+
+    static ThreadSlot& current()
+    {
+        static thread_local ThreadSlot slot = {nullptr, 0};
+        return slot;
+    }
+
+    std::vector<std::unique_ptr<Deque>> deques;
+    std::vector<std::thread> workers;
+
+    // jobs submitted by threads that don't own a deque
+    std::mutex injectedMutex;
+    std::deque<Job*> injected;
+
+    // jobs in the deques and queue, the idle workers sleep while it is 0
+    std::atomic<int> pendingJobs{0};
+    std::atomic<int> sleepingWorkers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool quit = false;
+
+    void submit(Job* job)
+    {
+        ThreadSlot &slot = current();
+        pendingJobs.fetch_add(1, std::memory_order_seq_cst);
+        if (slot.system == this)
+        {
+            if (!deques[slot.index]->push(job))
+            {
+                // full deque, run it now
+                pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+                execute(job);
+                return;
+            }
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            injected.push_back(job);
+        }
+        if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeUp.notify_one();
+        }
+    }
+
+    Job* findJob()
+    {
+        ThreadSlot &slot = current();
+        bool owner = slot.system == this;
+        if (owner)
+        {
+            if (Job* job = deques[slot.index]->pop())
+                return job;
+        }
+        {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            if (!injected.empty())
+            {
+                Job* job = injected.front();
+                injected.pop_front();
+                return job;
+            }
+        }
+        // steal, starting from a different victim on every thread
+        unsigned int count = (unsigned int) deques.size();
+        unsigned int start = owner ? slot.index + 1 : 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int victim = (start + i) % count;
+            if (owner && victim == slot.index)
+                continue;
+            if (Job* job = deques[victim]->steal())
+                return job;
+        }
+        return nullptr;
+    }
+
+    // runs one job if there is one, returns false otherwise
+    bool runOne()
+    {
+        Job* job = findJob();
+        if (!job)
+            return false;
+        pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        return true;
+    }
+
+    void execute(Job* job)
+    {
+        job->function();
+        Counter* signal = job->signal;
+        delete job;
+        if (!signal)
+            return;
+        std::vector<Job*> released;
+        {
+            std::lock_guard<std::mutex> lock(signal->mutex);
+            if (signal->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                released.swap(signal->dependents);
+        }
+        for (Job* dependent : released)
+            submit(dependent);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        current() = {this, index};
+        PROFILE_THREAD("job worker " + std::to_string(index));
+        while (true)
+        {
+            // spin a little before sleeping, new jobs often come in bursts
+            for (int spin = 0; spin < 64; spin++)
+            {
+                if (runOne())
+                    spin = 0;
+                else
+                    std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+            wakeUp.wait(lock, [this]() { return quit || pendingJobs.load(std::memory_order_seq_cst) > 0; });
+            sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+            if (quit)
+                return;
+        }
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_JOB_SYSTEM_H
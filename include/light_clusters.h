@@ -0,0 +1,313 @@
+//
+// Clustered forward lighting: point lights assigned to a 3D grid of view space clusters.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_LIGHT_CLUSTERS_H
+#define ITU_GRAPHICS_PROGRAMMING_LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <gl_state.h>
+#include <job_system.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ITU_LIGHT_CLUSTERS_SSE
+#endif
+
+struct PointLight {
+    glm::vec3 position;   // world space
+    glm::vec3 color;      // color * intensity
+    float radius = 0.0f;  // range of the light, 0 to derive it from the attenuation (see LightClusters::lightRadius)
+};
+
+// The view frustum is split in CLUSTERS_X * CLUSTERS_Y screen tiles and CLUSTERS_Z depth slices, with the
+// slices distributed exponentially between the near and far planes, so that clusters stay roughly cubic.
+// Every frame, the lights are moved to view space and each light sphere is tested against the view space
+// bounding boxes of the clusters, four clusters per SSE test, with the depth slices run as jobs of the JobSystem.
+// A light has no effect beyond its radius, the shader fades the attenuation to 0 at the radius.
+// The result is uploaded to three buffer textures that the fragment shader reads:
+//   lightData    RGBA32F, 2 texels per light: position (world) and radius, color
+//   clusterGrid  RG32UI, 1 texel per cluster: offset and count of the cluster in lightIndices
+//   lightIndices R32UI, the lights of each cluster one after the other
+// A fragment finds its cluster from gl_FragCoord.xy and its view space depth (see phong_shading.frag with
+// CLUSTERED_LIGHTS defined), and only shades the lights of that cluster.
+class LightClusters
+{
+public:
+    static const unsigned int CLUSTERS_X = 16;
+    static const unsigned int CLUSTERS_Y = 9;
+    static const unsigned int CLUSTERS_Z = 24;
+    static const unsigned int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    static const unsigned int MAX_LIGHTS_PER_CLUSTER = 256;
+
+    // texture units the buffer textures are bound to in bind()
+    static const unsigned int LIGHT_DATA_UNIT = 1;
+    static const unsigned int CLUSTER_GRID_UNIT = 2;
+    static const unsigned int LIGHT_INDICES_UNIT = 3;
+
+    // light contributions below this value are ignored, it sets the radius of the lights
+    float cutoff = 1.0f / 256.0f;
+    // CPU time of the last update(), in milliseconds
+    float lastAssignMs = 0.0f;
+
+    LightClusters()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            GLState::bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        GLState::bindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~LightClusters()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    // radius at which the attenuated light (1 / (c0 + c1 d + c2 d^2)) falls below 'cutoff'
+    float lightRadius(const glm::vec3 &color, const glm::vec3 &attenuation) const
+    {
+        float intensity = std::max(color.x, std::max(color.y, color.z));
+        // c2 d^2 + c1 d + c0 - intensity / cutoff = 0
+        float a = attenuation.z, b = attenuation.y, c = attenuation.x - intensity / cutoff;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (a <= 0.0f)
+            return b > 0.0f ? -c / b : 1.0e6f;
+        return (-b + std::sqrt(b * b - 4.0f * a * c)) / (2.0f * a);
+    }
+
+    // assign 'lights' to the clusters of the camera described by 'view' and 'projection' (a symmetric perspective
+    // projection from glm::perspective with 'near' and 'far' planes), and upload the result
+    void update(const std::vector<PointLight> &lights, const glm::vec3 &attenuation,
+                const glm::mat4 &view, const glm::mat4 &projection, float near, float far)
+    {
+        PROFILE_SCOPE("LightClusters::update");
+        auto start = std::chrono::steady_clock::now();
+
+        // the cluster boxes only change with the field of view, aspect ratio and depth range
+        glm::vec4 parameters(projection[0][0], projection[1][1], near, far);
+        if (parameters != clusterParameters)
+        {
+            clusterParameters = parameters;
+            this->near = near;
+            this->far = far;
+            computeClusterBounds(projection);
+        }
+
+        // lights in view space, as separate arrays for the SIMD tests
+        unsigned int n = (unsigned int) lights.size();
+        lightX.resize(n); lightY.resize(n); lightZ.resize(n); lightRadii.resize(n);
+        lightData.resize(n * 8);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float radius = lights[i].radius > 0.0f ? lights[i].radius : lightRadius(lights[i].color, attenuation);
+            lightX[i] = p.x; lightY[i] = p.y; lightZ[i] = p.z; lightRadii[i] = radius;
+
+            float* texels = &lightData[i * 8];
+            texels[0] = lights[i].position.x; texels[1] = lights[i].position.y; texels[2] = lights[i].position.z;
+            texels[3] = radius;
+            texels[4] = lights[i].color.x; texels[5] = lights[i].color.y; texels[6] = lights[i].color.z;
+            texels[7] = 0.0f;
+        }
+
+        // every job fills the cluster lists of one depth slice; the slices don't hold the same number of lights,
+        // small jobs balance the work better between the threads
+        clusterCounts.assign(CLUSTER_COUNT, 0);
+        clusterLists.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        JobSystem::instance().parallelFor(0, CLUSTERS_Z, 1, [this](unsigned int sliceBegin, unsigned int sliceEnd) {
+            assignSlices(sliceBegin, sliceEnd);
+        });
+
+        // compact the lists, and build the grid of offsets and counts
+        grid.resize(CLUSTER_COUNT * 2);
+        indices.clear();
+        for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            grid[cluster * 2] = (std::uint32_t) indices.size();
+            grid[cluster * 2 + 1] = clusterCounts[cluster];
+            const std::uint32_t* list = &clusterLists[cluster * MAX_LIGHTS_PER_CLUSTER];
+            indices.insert(indices.end(), list, list + clusterCounts[cluster]);
+        }
+        // an empty buffer texture can't be sampled, keep at least one element
+        if (indices.empty())
+            indices.push_back(0);
+        if (lightData.empty())
+            lightData.resize(8, 0.0f);
+
+        upload(0, lightData.data(), lightData.size() * sizeof(float));
+        upload(1, grid.data(), grid.size() * sizeof(std::uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(std::uint32_t));
+
+        lastAssignMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // bind the buffer textures, and set the uniforms the shader needs to find the cluster of a fragment
+    void bind(unsigned int program, int viewportWidth, int viewportHeight) const
+    {
+        const unsigned int units[3] = {LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, LIGHT_INDICES_UNIT};
+        const char* samplers[3] = {"lightData", "clusterGrid", "lightIndices"};
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            GLState::bindTextureUnit(units[i], GL_TEXTURE_BUFFER, textures[i]);
+            glUniform1i(glGetUniformLocation(program, samplers[i]), units[i]);
+        }
+        GLState::activeTexture(GL_TEXTURE0);
+
+        glUniform3ui(glGetUniformLocation(program, "clusterCount"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+        glUniform2f(glGetUniformLocation(program, "clusterTileSize"),
+                    (float) viewportWidth / CLUSTERS_X, (float) viewportHeight / CLUSTERS_Y);
+        // slice = log(depth / near) * sliceScale
+        glUniform2f(glGetUniformLocation(program, "clusterDepth"), near, CLUSTERS_Z / std::log(far / near));
+    }
+
+    // size of the light lists of the last update
+    unsigned int totalLightIndices() const { return (unsigned int) indices.size(); }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+private:
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    float near = 0.1f, far = 100.0f;
+
+    // view space bounding boxes of the clusters, as separate arrays padded to a multiple of 4 per slice
+    glm::vec4 clusterParameters = glm::vec4(0.0f);
+    static const unsigned int TILES_PER_SLICE = CLUSTERS_X * CLUSTERS_Y;
+    static const unsigned int PADDED_TILES = (TILES_PER_SLICE + 3u) & ~3u;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    std::vector<float> lightX, lightY, lightZ, lightRadii;
+    std::vector<float> lightData;
+    std::vector<std::uint32_t> clusterCounts, clusterLists, grid, indices;
+
+    float sliceDepth(unsigned int slice) const
+    {
+        return near * std::pow(far / near, (float) slice / CLUSTERS_Z);
+    }
+
+    void computeClusterBounds(const glm::mat4 &projection)
+    {
+        unsigned int size = PADDED_TILES * CLUSTERS_Z;
+        // the padding boxes are points at the largest float, the squared distance of any light to them
+        // overflows to infinity, so the sphere / box test never passes for them
+        const float away = std::numeric_limits<float>::max();
+        minX.assign(size, away); minY.assign(size, away); minZ.assign(size, away);
+        maxX.assign(size, away); maxY.assign(size, away); maxZ.assign(size, away);
+
+        // with a symmetric projection, a point at depth d (view space z = -d) and ndc.x = x is at view space x * d / P00
+        float scaleX = 1.0f / projection[0][0], scaleY = 1.0f / projection[1][1];
+        for (unsigned int z = 0; z < CLUSTERS_Z; z++)
+        {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < CLUSTERS_Y; y++)
+            {
+                float ndcY0 = -1.0f + 2.0f * y / CLUSTERS_Y, ndcY1 = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y;
+                for (unsigned int x = 0; x < CLUSTERS_X; x++)
+                {
+                    float ndcX0 = -1.0f + 2.0f * x / CLUSTERS_X, ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTERS_X;
+                    unsigned int i = z * PADDED_TILES + y * CLUSTERS_X + x;
+                    minX[i] = std::min(ndcX0 * d0, ndcX0 * d1) * scaleX;
+                    maxX[i] = std::max(ndcX1 * d0, ndcX1 * d1) * scaleX;
+                    minY[i] = std::min(ndcY0 * d0, ndcY0 * d1) * scaleY;
+                    maxY[i] = std::max(ndcY1 * d0, ndcY1 * d1) * scaleY;
+                    minZ[i] = -d1;
+                    maxZ[i] = -d0;
+                }
+            }
+        }
+    }
+
+    // assign the lights to the clusters of the depth slices [sliceBegin, sliceEnd)
+    void assignSlices(unsigned int sliceBegin, unsigned int sliceEnd)
+    {
+        PROFILE_SCOPE("LightClusters::assignSlices");
+        for (unsigned int slice = sliceBegin; slice < sliceEnd; slice++)
+        {
+            float sliceNear = sliceDepth(slice), sliceFar = sliceDepth(slice + 1);
+            for (unsigned int light = 0; light < lightX.size(); light++)
+            {
+                // most lights don't reach most slices, skip them before testing the clusters
+                float depth = -lightZ[light];
+                if (depth + lightRadii[light] < sliceNear || depth - lightRadii[light] > sliceFar)
+                    continue;
+                assignLight(light, slice);
+            }
+        }
+    }
+
+    void addToCluster(unsigned int cluster, unsigned int light)
+    {
+        std::uint32_t &count = clusterCounts[cluster];
+        if (count < MAX_LIGHTS_PER_CLUSTER)
+            clusterLists[cluster * MAX_LIGHTS_PER_CLUSTER + count++] = light;
+    }
+
+    // sphere / box test: the squared distance from the center to the box is at most radius^2
+    void assignLight(unsigned int light, unsigned int slice)
+    {
+        float cx = lightX[light], cy = lightY[light], cz = lightZ[light], r = lightRadii[light];
+        unsigned int base = slice * PADDED_TILES;
+        unsigned int firstCluster = slice * TILES_PER_SLICE;
+#ifdef ITU_LIGHT_CLUSTERS_SSE
+        __m128 x = _mm_set1_ps(cx), y = _mm_set1_ps(cy), z = _mm_set1_ps(cz);
+        __m128 r2 = _mm_set1_ps(r * r), zero = _mm_setzero_ps();
+        for (unsigned int tile = 0; tile < PADDED_TILES; tile += 4)
+        {
+            unsigned int i = base + tile;
+            __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[i]), x), _mm_sub_ps(x, _mm_loadu_ps(&maxX[i]))), zero);
+            __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[i]), y), _mm_sub_ps(y, _mm_loadu_ps(&maxY[i]))), zero);
+            __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[i]), z), _mm_sub_ps(z, _mm_loadu_ps(&maxZ[i]))), zero);
+            __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, r2));
+            // the padding boxes never pass (see computeClusterBounds), the tile check only guards the cluster index
+            for (unsigned int j = 0; mask != 0; j++, mask >>= 1)
+            {
+                if ((mask & 1) && tile + j < TILES_PER_SLICE)
+                    addToCluster(firstCluster + tile + j, light);
+            }
+        }
+#else
+        for (unsigned int tile = 0; tile < TILES_PER_SLICE; tile++)
+        {
+            unsigned int i = base + tile;
+            float dx = std::max(std::max(minX[i] - cx, cx - maxX[i]), 0.0f);
+            float dy = std::max(std::max(minY[i] - cy, cy - maxY[i]), 0.0f);
+            float dz = std::max(std::max(minZ[i] - cz, cz - maxZ[i]), 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= r * r)
+                addToCluster(firstCluster + tile, light);
+        }
+#endif
+    }
+
+    void upload(unsigned int buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        // orphan the storage the GPU may still be reading from
+        glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_LIGHT_CLUSTERS_H
@@ -0,0 +1,285 @@
+//
+// Occlusion culling with GPU occlusion queries and conditional rendering.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_OCCLUSION_CULLER_H
+#define ITU_GRAPHICS_PROGRAMMING_OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gl_state.h>
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// Objects that may be hidden behind others (e.g. the interior of a car behind its body) are tracked by a key.
+// After the opaque pass, the bounding boxes of the tracked objects that were occluded, or that only recently
+// became visible, are drawn depth-only inside GL_ANY_SAMPLES_PASSED queries. The next frame:
+//  - the draw of the object is wrapped in glBeginConditionalRender with that query (GL_QUERY_NO_WAIT),
+//    so the GPU skips it if the box was hidden, or draws it if the result is not ready yet;
+//  - the CPU polls GL_QUERY_RESULT_AVAILABLE and reads the results that are ready, which decides what gets
+//    tested next and lets it skip submitting objects that are known to be occluded.
+// No result is ever waited for, a late query only makes the object be drawn (or tested) one more time.
+// Objects that stayed visible for a while are only re-tested every RETEST_INTERVAL frames. An object that comes
+// back into the frustum is handled as visible until a new test says otherwise.
+class OcclusionCuller
+{
+public:
+    // an object is borderline during its first frames of visibility, and tested every frame
+    static const unsigned int BORDERLINE_FRAMES = 4;
+    static const unsigned int RETEST_INTERVAL = 8;
+
+    struct Visibility {
+        bool skip;                   // the object was occluded last frame, don't draw it
+        unsigned int conditionQuery; // if not 0, draw the object inside a conditional render on this query
+    };
+
+    struct Stats {
+        unsigned int tracked = 0;
+        unsigned int occluded = 0;   // skipped on the CPU side
+        unsigned int tested = 0;     // boxes drawn in queries
+    };
+
+    bool enabled = true;
+
+    OcclusionCuller()
+    {
+        createBoxProgram();
+        createBoxVertexArray();
+    }
+
+    ~OcclusionCuller()
+    {
+        for (auto &entry : objects)
+            glDeleteQueries(1, &entry.second.query);
+        glDeleteProgram(boxProgram);
+        glDeleteVertexArrays(1, &boxVAO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteBuffers(1, &boxEBO);
+    }
+
+    // start a new frame, reads the results that are available and stores the matrix used to draw the boxes
+    void newFrame(const glm::mat4 &viewProjection)
+    {
+        frame++;
+        this->viewProjection = viewProjection;
+        lastStats = stats;
+        stats = Stats();
+        tests.clear();
+
+        for (auto &entry : objects)
+        {
+            Object &object = entry.second;
+            if (!object.pending)
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint anySamples = 0;
+            glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &anySamples);
+            object.pending = false;
+            object.resultFrame = object.issuedFrame;
+            object.visible = anySamples != 0;
+            object.visibleFrames = object.visible ? object.visibleFrames + 1 : 0;
+        }
+    }
+
+    // register the object 'key' for this frame, with its model space box transformed by 'model',
+    // returns how the object should be drawn; call it only for the objects inside of the view frustum
+    Visibility track(const void* key, const glm::mat4 &model, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax)
+    {
+        if (!enabled)
+            return {false, 0};
+
+        Object &object = objects[key];
+        if (object.query == 0)
+            glGenQueries(1, &object.query);
+        stats.tracked++;
+
+        // the object was not tracked last frame (it was out of the frustum, or the culler was off), its last
+        // result says nothing about where it is now, so it starts over as visible and borderline; a query still
+        // in flight is dropped, the test below reuses the query object
+        if (object.trackedFrame + 1 != frame)
+        {
+            object.pending = false;
+            object.visible = true;
+            object.visibleFrames = 0;
+            object.resultFrame = 0;
+        }
+        object.trackedFrame = frame;
+
+        // the result of last frame's test is on the CPU already and says occluded
+        bool knownOccluded = !object.visible && object.resultFrame + 1 == frame;
+        // the test was issued last frame, the GPU can use it even if the CPU did not read it
+        unsigned int conditionQuery = object.issuedFrame + 1 == frame ? object.query : 0;
+
+        bool borderline = object.visibleFrames < BORDERLINE_FRAMES;
+        bool retest = frame - object.issuedFrame >= RETEST_INTERVAL;
+        if (!object.pending && (!object.visible || borderline || retest))
+        {
+            glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+            glm::vec3 halfSize = (aabbMax - aabbMin) * 0.5f;
+            tests.push_back({&object, model * glm::scale(glm::translate(glm::mat4(1.0f), center), halfSize)});
+        }
+
+        if (knownOccluded)
+        {
+            stats.occluded++;
+            return {true, 0};
+        }
+        // an object that is drawn unconditionally keeps its conditional render only while it is being tested
+        return {false, conditionQuery};
+    }
+
+    // draw the boxes of the objects to test, call it once the occluders are in the depth buffer
+    // (i.e. at the end of the opaque pass)
+    void issueQueries()
+    {
+        if (tests.empty())
+            return;
+
+        GLboolean depthWrites, colorWrites[4];
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &depthWrites);
+        glGetBooleanv(GL_COLOR_WRITEMASK, colorWrites);
+        GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+        // depth test only, the boxes must not change the frame
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        // the camera can be inside a box
+        glDisable(GL_CULL_FACE);
+
+        GLState::useProgram(boxProgram);
+        GLState::bindVertexArray(boxVAO);
+        for (const Test &test : tests)
+        {
+            glm::mat4 mvp = viewProjection * test.boxModel;
+            glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, test.object->query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            test.object->issuedFrame = frame;
+            test.object->pending = true;
+            stats.tested++;
+        }
+        GLState::bindVertexArray(0);
+
+        glColorMask(colorWrites[0], colorWrites[1], colorWrites[2], colorWrites[3]);
+        glDepthMask(depthWrites);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+        tests.clear();
+    }
+
+    // counters of the last complete frame
+    const Stats& getStats() const { return lastStats; }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+private:
+    struct Object {
+        unsigned int query = 0;
+        bool pending = false;        // issued, result not read yet
+        bool visible = true;         // last result read
+        unsigned int visibleFrames = 0;
+        unsigned int issuedFrame = 0;
+        unsigned int resultFrame = 0; // frame in which the last read result was issued
+        unsigned int trackedFrame = 0; // last frame in which track() was called for the object
+    };
+
+    struct Test {
+        Object* object;
+        glm::mat4 boxModel;
+    };
+
+    // frames start at 1, so that 0 means never
+    unsigned int frame = 1;
+    // objects are never erased, so the pointers in 'tests' stay valid
+    std::unordered_map<const void*, Object> objects;
+    std::vector<Test> tests;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    Stats stats, lastStats;
+
+    unsigned int boxProgram = 0, boxVAO = 0, boxVBO = 0, boxEBO = 0;
+    int mvpLocation = -1;
+
+    void createBoxProgram()
+    {
+        const char* vertexSource =
+                "#version 330 core\n"
+                "layout (location = 0) in vec3 pos;\n"
+                "uniform mat4 mvp;\n"
+                "void main() { gl_Position = mvp * vec4(pos, 1.0); }\n";
+        const char* fragmentSource =
+                "#version 330 core\n"
+                "out vec4 FragColor;\n"
+                "void main() { FragColor = vec4(1.0); }\n";
+
+        unsigned int vertex = compile(GL_VERTEX_SHADER, vertexSource);
+        unsigned int fragment = compile(GL_FRAGMENT_SHADER, fragmentSource);
+        boxProgram = glCreateProgram();
+        glAttachShader(boxProgram, vertex);
+        glAttachShader(boxProgram, fragment);
+        glLinkProgram(boxProgram);
+        int success;
+        glGetProgramiv(boxProgram, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetProgramInfoLog(boxProgram, 1024, NULL, infoLog);
+            std::cout << "ERROR::OCCLUSION_CULLER::PROGRAM_LINKING_ERROR\n" << infoLog << std::endl;
+        }
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        mvpLocation = glGetUniformLocation(boxProgram, "mvp");
+    }
+
+    static unsigned int compile(GLenum type, const char* source)
+    {
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cout << "ERROR::OCCLUSION_CULLER::SHADER_COMPILATION_ERROR\n" << infoLog << std::endl;
+        }
+        return shader;
+    }
+
+    // cube from -1 to 1, scaled and moved onto each box
+    void createBoxVertexArray()
+    {
+        const float vertices[] = {
+                -1, -1, -1,   1, -1, -1,   1,  1, -1,  -1,  1, -1,
+                -1, -1,  1,   1, -1,  1,   1,  1,  1,  -1,  1,  1
+        };
+        const unsigned int indices[] = {
+                0, 2, 1,  0, 3, 2,   4, 5, 6,  4, 6, 7,
+                0, 1, 5,  0, 5, 4,   3, 6, 2,  3, 7, 6,
+                0, 4, 7,  0, 7, 3,   1, 2, 6,  1, 6, 5
+        };
+
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glGenBuffers(1, &boxEBO);
+        GLState::bindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        GLState::bindVertexArray(0);
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_OCCLUSION_CULLER_H
@@ -0,0 +1,250 @@
+//
+// Scoped CPU profiler: PROFILE_SCOPE("name") records the time spent in a scope, per thread.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_PROFILER_H
+#define ITU_GRAPHICS_PROGRAMMING_PROFILER_H
+
+// The profiler is built when ITU_PROFILER is defined (the ITU_PROFILER CMake option, on by default).
+// Without it, the macros expand to nothing and the Profiler namespace doesn't exist, so code that reads the
+// profile (e.g. a GUI) must be inside #ifdef ITU_PROFILER too.
+//   PROFILE_SCOPE("name")   time the rest of the enclosing scope; 'name' must be a string literal
+//   PROFILE_FUNCTION()      same, named after the enclosing function
+//   PROFILE_FRAME()         mark the start of a frame, call it once per frame on the main thread
+//   PROFILE_THREAD("name")  name the calling thread in the trace
+#ifdef ITU_PROFILER
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#define PROFILE_FRAME() Profiler::newFrame()
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+
+// Every thread writes its events to its own ring buffer, without locks: an event is written, then the count of
+// written events is published (release). Readers copy the events below the published count, and discard the ones
+// that the thread may have overwritten in the meantime. Only the registration of a new thread takes a lock.
+// The timestamps are nanoseconds since the start of the profiler.
+namespace Profiler {
+
+    // events kept per thread, and frames kept by newFrame()
+    const unsigned int EVENT_CAPACITY = 1u << 16;
+    const unsigned int FRAME_CAPACITY = 256;
+
+    struct Event {
+        const char* name;
+        std::uint64_t begin, end;
+        std::uint32_t depth; // number of enclosing scopes on the same thread
+    };
+
+    struct ThreadBuffer {
+        unsigned int index = 0;
+        std::string name;
+        bool named = false; // by setThreadName()
+        std::uint32_t depth = 0;
+        std::atomic<std::uint64_t> written{0};
+        Event events[EVENT_CAPACITY];
+    };
+
+    struct Registry {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::mutex mutex; // guards 'threads' and the thread names
+        std::vector<std::unique_ptr<ThreadBuffer>> threads;
+        // the thread that calls newFrame(), whatever the order in which the threads registered
+        ThreadBuffer* mainThread = nullptr;
+        // start of the last frames, written by the thread that calls newFrame()
+        std::uint64_t frames[FRAME_CAPACITY];
+        std::atomic<std::uint64_t> frameCount{0};
+    };
+
+    inline Registry& registry(){
+        static Registry instance;
+        return instance;
+    }
+
+    inline std::uint64_t now(){
+        return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - registry().start).count();
+    }
+
+    // the buffer of the calling thread, registered on first use (the buffers live until the program exits)
+    inline ThreadBuffer& threadBuffer(){
+        static thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.emplace_back(new ThreadBuffer());
+            buffer = r.threads.back().get();
+            buffer->index = (unsigned int) r.threads.size() - 1;
+            buffer->name = "thread " + std::to_string(buffer->index);
+        }
+        return *buffer;
+    }
+
+    inline void setThreadName(const std::string &name){
+        ThreadBuffer &buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer.name = name;
+        buffer.named = true;
+    }
+
+    inline void record(ThreadBuffer &buffer, const char* name, std::uint64_t begin, std::uint64_t end, std::uint32_t depth){
+        std::uint64_t i = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[i % EVENT_CAPACITY] = {name, begin, end, depth};
+        buffer.written.store(i + 1, std::memory_order_release);
+    }
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : buffer(threadBuffer()), name(name), depth(buffer.depth++), begin(now()) {}
+        ~Scope(){
+            buffer.depth--;
+            record(buffer, name, begin, now(), depth);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        ThreadBuffer &buffer;
+        const char* name;
+        std::uint32_t depth;
+        std::uint64_t begin;
+    };
+
+    inline void newFrame(){
+        // the calling thread is the main thread of the GUI, even if other threads (e.g. an encoder started by a
+        // constructor) registered before it
+        static thread_local bool isMainThread = false;
+        Registry &r = registry();
+        if (!isMainThread)
+        {
+            ThreadBuffer &buffer = threadBuffer();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.mainThread = &buffer;
+            if (!buffer.named)
+                buffer.name = "main";
+            isMainThread = true;
+        }
+        std::uint64_t i = r.frameCount.load(std::memory_order_relaxed);
+        r.frames[i % FRAME_CAPACITY] = now();
+        r.frameCount.store(i + 1, std::memory_order_release);
+    }
+
+    // time range of the frame started 'framesAgo' frames before the current one (1 is the last complete frame),
+    // false if that frame is not known anymore
+    inline bool frameRange(unsigned int framesAgo, std::uint64_t &begin, std::uint64_t &end){
+        Registry &r = registry();
+        std::uint64_t count = r.frameCount.load(std::memory_order_acquire);
+        if (framesAgo == 0 || framesAgo >= count || framesAgo >= FRAME_CAPACITY)
+            return false;
+        begin = r.frames[(count - 1 - framesAgo) % FRAME_CAPACITY];
+        end = r.frames[(count - framesAgo) % FRAME_CAPACITY];
+        return true;
+    }
+
+    // appends the events of 'buffer' that overlap [begin, end) to 'events'
+    inline void collect(const ThreadBuffer &buffer, std::uint64_t begin, std::uint64_t end, std::vector<Event> &events){
+        std::uint64_t written = buffer.written.load(std::memory_order_acquire);
+        std::uint64_t first = written > EVENT_CAPACITY ? written - EVENT_CAPACITY : 0;
+        std::vector<std::uint64_t> indices;
+        size_t start = events.size();
+        for (std::uint64_t i = first; i < written; i++)
+        {
+            const Event &event = buffer.events[i % EVENT_CAPACITY];
+            if (event.end > begin && event.begin < end)
+            {
+                events.push_back(event);
+                indices.push_back(i);
+            }
+        }
+        // the thread kept recording while the events were copied, drop the ones it may have overwritten, including
+        // the oldest slot, which it may be writing right now; the fence keeps the copies before the load
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::uint64_t writtenAfter = buffer.written.load(std::memory_order_relaxed);
+        std::uint64_t firstValid = writtenAfter >= EVENT_CAPACITY ? writtenAfter - EVENT_CAPACITY + 1 : 0;
+        if (firstValid > first)
+        {
+            size_t kept = start;
+            for (size_t i = 0; i < indices.size(); i++)
+                if (indices[i] >= firstValid)
+                    events[kept++] = events[start + i];
+            events.resize(kept);
+        }
+    }
+
+    // the events of the main thread (the one that calls PROFILE_FRAME) in [begin, end)
+    inline std::vector<Event> mainThreadEvents(std::uint64_t begin, std::uint64_t end){
+        std::vector<Event> events;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.mainThread)
+            collect(*r.mainThread, begin, end, events);
+        return events;
+    }
+
+    inline void writeJsonString(std::FILE* file, const std::string &text){
+        std::fputc('"', file);
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                std::fputc('\\', file);
+            if ((unsigned char) c >= 0x20)
+                std::fputc(c, file);
+        }
+        std::fputc('"', file);
+    }
+
+    // writes the events kept by all the threads in the Chrome trace format (chrome://tracing, ui.perfetto.dev)
+    inline bool writeChromeTrace(const std::string &path){
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        bool first = true;
+        for (const std::unique_ptr<ThreadBuffer> &thread : r.threads)
+        {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":",
+                         first ? "" : ",\n", thread->index);
+            writeJsonString(file, thread->name);
+            std::fputs("}}", file);
+            first = false;
+
+            std::vector<Event> events;
+            collect(*thread, 0, UINT64_MAX, events);
+            for (const Event &event : events)
+            {
+                // complete events ("X"), in microseconds
+                std::fputs(",\n{\"name\":", file);
+                writeJsonString(file, event.name);
+                std::fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                             thread->index, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+            }
+        }
+        std::fputs("\n]}\n", file);
+        std::fclose(file);
+        return true;
+    }
+}
+
+#else
+
+#define PROFILE_SCOPE(name) ((void) 0)
+#define PROFILE_FUNCTION() ((void) 0)
+#define PROFILE_FRAME() ((void) 0)
+#define PROFILE_THREAD(name) ((void) 0)
+
+#endif // ITU_PROFILER
+
+#endif //ITU_GRAPHICS_PROGRAMMING_PROFILER_H
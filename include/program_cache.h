@@ -0,0 +1,176 @@
+//
+// Shader program binary cache, shared by the Shader classes of the exercises and assignments.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_PROGRAM_CACHE_H
+#define ITU_GRAPHICS_PROGRAMMING_PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// Stores linked program binaries on disk (glGetProgramBinary/glProgramBinary) so that a shader program is
+// compiled from source only once per driver. A binary is keyed by a hash of the shader sources, the defines
+// and the GL vendor/renderer/version strings, so a modified shader or an updated driver gets a new key.
+// A binary that the driver rejects is deleted and the caller falls back to compiling from source.
+// Requires OpenGL 4.1, with older contexts every function is a no-op.
+namespace ProgramCache {
+
+    // folder where the binaries are stored, relative to the working directory (i.e. the build folder)
+    inline std::string& directory(){
+        static std::string dir = "shader_cache";
+        return dir;
+    }
+
+    // can be turned off, for instance while editing shaders
+    inline bool& enabled(){
+        static bool isEnabled = true;
+        return isEnabled;
+    }
+
+    // FNV-1a, 64 bits
+    inline std::uint64_t hash(const std::string &data, std::uint64_t h = 14695981039346656037ull){
+        for (unsigned char c : data){
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    inline bool isSupported(){
+        if (!enabled() || !GLAD_GL_VERSION_4_1)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // true if the driver lists 'format' in GL_PROGRAM_BINARY_FORMATS
+    inline bool isFormatSupported(GLenum format){
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        std::vector<GLint> formats(count > 0 ? count : 0);
+        if (!formats.empty())
+            glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        for (GLint supported : formats) {
+            if ((GLenum) supported == format)
+                return true;
+        }
+        return false;
+    }
+
+    // key of a program built from 'sources' (in attach order) specialized with 'defines'
+    inline std::string makeKey(const std::vector<std::string> &sources, const std::string &defines = ""){
+        auto glString = [](GLenum name){
+            const GLubyte* str = glGetString(name);
+            return std::string(str ? (const char*) str : "");
+        };
+        std::uint64_t h = hash(glString(GL_VENDOR));
+        h = hash(glString(GL_RENDERER), h);
+        h = hash(glString(GL_VERSION), h);
+        h = hash(defines, h);
+        for (const std::string &source : sources) {
+            // separator, so that moving text between two stages changes the key
+            h = hash(source, h ^ 0xFFu);
+        }
+
+        char key[17];
+        std::snprintf(key, sizeof(key), "%016llx", (unsigned long long) h);
+        return std::string(key);
+    }
+
+    inline std::string pathFor(const std::string &key){
+        return directory() + "/" + key + ".bin";
+    }
+
+    // file layout: magic | binary format | binary length | binary
+    const std::uint32_t magic = 0x42505047; // "GPPB"
+
+    // tries to load the binary stored under 'key' into 'program',
+    // returns true if the program is linked and ready to use
+    inline bool load(GLuint program, const std::string &key){
+        if (!isSupported())
+            return false;
+
+        std::ifstream file(pathFor(key), std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        std::streamoff fileSize = file.tellg();
+        file.seekg(0);
+
+        std::uint32_t header[3] = {0, 0, 0};
+        file.read((char*) header, sizeof(header));
+        // a truncated or foreign file must not get to allocate whatever its length field says
+        if (!file || header[0] != magic || header[2] == 0 || header[2] > fileSize - (std::streamoff) sizeof(header))
+            return false;
+        std::vector<char> binary(header[2]);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+        file.close();
+
+        // a binary written by another driver may use a format this one does not know,
+        // glProgramBinary would raise GL_INVALID_ENUM for it, so it is rejected up front
+        if (!isFormatSupported((GLenum) header[1])) {
+            std::remove(pathFor(key).c_str());
+            return false;
+        }
+        glProgramBinary(program, (GLenum) header[1], binary.data(), (GLsizei) binary.size());
+
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // stale binary (e.g. driver changed without changing its version string), rebuild it from source
+            std::remove(pathFor(key).c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // must be called before glLinkProgram, so that the driver keeps the binary around for store()
+    inline void prepare(GLuint program){
+        if (isSupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a successfully linked 'program' under 'key'
+    inline void store(GLuint program, const std::string &key){
+        if (!isSupported())
+            return;
+
+        GLint success = 0, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+#ifdef _WIN32
+        _mkdir(directory().c_str());
+#else
+        mkdir(directory().c_str(), 0755);
+#endif
+        std::ofstream file(pathFor(key), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cout << "WARNING::PROGRAM_CACHE::CANNOT_WRITE " << pathFor(key) << std::endl;
+            return;
+        }
+        std::uint32_t header[3] = {magic, (std::uint32_t) format, (std::uint32_t) length};
+        file.write((const char*) header, sizeof(header));
+        file.write(binary.data(), length);
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_PROGRAM_CACHE_H
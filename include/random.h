@@ -0,0 +1,175 @@
+//
+// Random number streams: small, seedable generators that replace rand() and can be split between threads.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RANDOM_H
+#define ITU_GRAPHICS_PROGRAMMING_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ITU_RANDOM_SSE
+#endif
+
+// xoshiro128+ (Blackman and Vigna): 128 bits of state, a period of 2^128 - 1, and a jump() that advances the stream
+// by 2^64 numbers in a few hundred steps. The same seed always gives the same numbers, on every platform.
+// Unlike rand(), a Random has no global state: every user (e.g. every thread) has its own stream, and split() hands
+// out streams that do not overlap for the first 2^64 numbers, so parallel code stays reproducible.
+// The upper bits are the best ones of xoshiro128+, nextFloat() uses the upper 24.
+class Random
+{
+public:
+    // the state is filled with splitmix64 from 'seed', so close seeds still give unrelated streams
+    explicit Random(std::uint64_t seed = 0)
+    {
+        std::uint64_t a = splitMix64(seed), b = splitMix64(seed);
+        state[0] = (std::uint32_t) a;
+        state[1] = (std::uint32_t) (a >> 32);
+        state[2] = (std::uint32_t) b;
+        state[3] = (std::uint32_t) (b >> 32);
+    }
+
+    std::uint32_t nextUInt()
+    {
+        std::uint32_t result = state[0] + state[3];
+        std::uint32_t t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = (state[3] << 11) | (state[3] >> 21);
+        return result;
+    }
+
+    // in [0, 1)
+    float nextFloat() { return (float) (nextUInt() >> 8) * (1.0f / 16777216.0f); }
+
+    // in [min, max)
+    float between(float min, float max) { return min + nextFloat() * (max - min); }
+
+    // in [0, n), without the bias of nextUInt() % n being noticeable for small n (multiply and shift)
+    unsigned int below(unsigned int n) { return (unsigned int) (((std::uint64_t) nextUInt() * n) >> 32); }
+
+    // advances the stream by 2^64 numbers
+    void jump()
+    {
+        static const std::uint32_t JUMP[] = {0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+        std::uint32_t jumped[4] = {0, 0, 0, 0};
+        for (std::uint32_t word : JUMP)
+            for (int bit = 0; bit < 32; bit++)
+            {
+                if (word & (1u << bit))
+                    for (int i = 0; i < 4; i++)
+                        jumped[i] ^= state[i];
+                nextUInt();
+            }
+        for (int i = 0; i < 4; i++)
+            state[i] = jumped[i];
+    }
+
+    // returns this stream as it is, and moves this one 2^64 numbers ahead; e.g. one split() per thread
+    Random split()
+    {
+        Random stream = *this;
+        jump();
+        return stream;
+    }
+
+private:
+    friend class RandomBatch;
+    std::uint32_t state[4];
+
+    static std::uint64_t splitMix64(std::uint64_t &x)
+    {
+        std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+// Fills arrays with random numbers four at a time: four xoshiro128+ streams, split from the stream it is built
+// from, advanced side by side in the lanes of an SSE2 register. Lane j of call i gives element 4 * i + j.
+// Without SSE2 the lanes are advanced one after the other, with the same results.
+class RandomBatch
+{
+public:
+    static const unsigned int LANES = 4;
+
+    // takes LANES streams from 'stream' (which moves LANES * 2^64 numbers ahead)
+    explicit RandomBatch(Random &stream)
+    {
+        for (unsigned int lane = 0; lane < LANES; lane++)
+        {
+            Random laneStream = stream.split();
+            for (unsigned int i = 0; i < 4; i++)
+                state[i][lane] = laneStream.state[i];
+        }
+    }
+
+    // 'count' floats in [min, max)
+    void fill(float* out, std::size_t count, float min, float max)
+    {
+        float scale = (max - min) * (1.0f / 16777216.0f);
+        std::size_t i = 0;
+#ifdef ITU_RANDOM_SSE
+        __m128i s0 = load(0), s1 = load(1), s2 = load(2), s3 = load(3);
+        const __m128 offset = _mm_set1_ps(min), factor = _mm_set1_ps(scale);
+        for (; i + LANES <= count; i += LANES)
+        {
+            __m128i result = _mm_add_epi32(s0, s3);
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+            __m128 unit = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+            _mm_storeu_ps(out + i, _mm_add_ps(offset, _mm_mul_ps(unit, factor)));
+        }
+        store(0, s0);
+        store(1, s1);
+        store(2, s2);
+        store(3, s3);
+#endif
+        std::uint32_t values[LANES];
+        for (; i < count; i += LANES)
+        {
+            next(values);
+            for (unsigned int lane = 0; lane < LANES && i + lane < count; lane++)
+                out[i + lane] = min + (float) (values[lane] >> 8) * scale;
+        }
+    }
+
+private:
+    // state[i][lane] is word i of the xoshiro128+ state of a lane
+    std::uint32_t state[4][LANES];
+
+    // one number per lane
+    void next(std::uint32_t* values)
+    {
+        for (unsigned int lane = 0; lane < LANES; lane++)
+        {
+            std::uint32_t &s0 = state[0][lane], &s1 = state[1][lane], &s2 = state[2][lane], &s3 = state[3][lane];
+            values[lane] = s0 + s3;
+            std::uint32_t t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 11) | (s3 >> 21);
+        }
+    }
+
+#ifdef ITU_RANDOM_SSE
+    __m128i load(int word) const { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(state[word])); }
+    void store(int word, __m128i value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(state[word]), value); }
+#endif
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RANDOM_H
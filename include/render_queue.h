@@ -0,0 +1,449 @@
+//
+// Render queue that sorts the draws of a frame by GL state before issuing them.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RENDER_QUEUE_H
+#define ITU_GRAPHICS_PROGRAMMING_RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <frustum.h>
+#include <gl_state.h>
+#include <gpu_timer.h>
+#include <gpu_profiler.h>
+#include <profiler.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Draws are submitted during the frame and issued together in execute(). Every draw gets a 64 bit sort key,
+//
+//   opaque pass:  | pass 2 | program 8 | material 12 | VAO 12 | depth 30 |   -> grouped by state, then front to back
+//   blended pass: | pass 2 | ~depth 30 | program 8 | material 12 | VAO 12 |   -> back to front, then grouped by state
+//
+// the keys are radix sorted and the draws are issued through GLState (see gl_state.h), so that binds of state
+// that is already current are skipped. Program, material and VAO fields hold the low bits
+// of the GL names, two names that share those bits are only sorted next to each other, they are never mixed up.
+// Draws with equal keys keep their submission order.
+// If a frustum is set, the draws whose bounding sphere is outside of it are dropped before sorting, with the
+// spheres of all the draws tested together in one batch.
+// A callback can run at the end of each pass, for instance to issue occlusion queries against the opaque depth.
+// With the depth pre-pass on, the opaque draws are first issued with a depth-only program and color writes off,
+// then shaded with the GL_EQUAL depth test and depth writes off, so each pixel is shaded once. The vertex shaders
+// of the shaded and the depth-only programs must compute gl_Position with the same expression, declared invariant.
+class RenderQueue
+{
+public:
+    enum Pass { OPAQUE_PASS = 0, BLENDED_PASS = 1 };
+
+    static const unsigned int MAX_TEXTURES = 4;
+
+    struct Draw {
+        unsigned int program = 0;
+        unsigned int VAO = 0;
+        // textures bound to units 0, 1, ... textureCount-1 (GL_TEXTURE_2D)
+        unsigned int textures[MAX_TEXTURES] = {0, 0, 0, 0};
+        unsigned int textureCount = 0;
+        // id of the texture set, draws of the same material are issued next to each other
+        unsigned int material = 0;
+
+        GLenum mode = GL_TRIANGLES;
+        bool indexed = true;       // glDrawElements with GL_UNSIGNED_INT indices, otherwise glDrawArrays
+        GLint first = 0;
+        GLsizei count = 0;
+        GLsizei instanceCount = 0; // 0 for a non-instanced draw
+        // non-indexed, non-instanced draws: if not empty, one glMultiDrawArrays of these ranges instead of first/count
+        std::vector<GLint> firsts;
+        std::vector<GLsizei> counts;
+
+        // sets the per draw uniforms (e.g. model matrix), called with the program of the draw in use
+        std::function<void()> setUniforms;
+
+        // world space bounding sphere (center xyz, radius), a negative radius disables culling for the draw
+        float bounds[4] = {0.0f, 0.0f, 0.0f, -1.0f};
+
+        // model matrix used by the depth pre-pass (instanced draws read theirs from the instance attributes)
+        glm::mat4 model = glm::mat4(1.0f);
+
+        // if not 0, the draw is skipped by the GPU when this occlusion query found no samples,
+        // the draw goes through while the result is not available yet (GL_QUERY_NO_WAIT)
+        unsigned int conditionQuery = 0;
+    };
+
+    // bind/skip counters of the last execute()
+    struct Stats {
+        unsigned int submitted = 0;
+        unsigned int culled = 0;
+        unsigned int draws = 0;
+        unsigned int programBinds = 0;
+        unsigned int vaoBinds = 0;
+        unsigned int textureBinds = 0;
+        // binds that an unsorted, unshadowed submission would have issued on top of the ones above
+        unsigned int savedBinds = 0;
+        // GPU time of the opaque pass, and of the depth pre-pass when it is on (averages, in ms)
+        float opaqueMs = 0.0f;
+        float depthPrepassMs = 0.0f;
+    };
+
+    // 'depth' is the (non negative) distance from the camera, used to order the draws inside a pass
+    void submit(Pass pass, float depth, Draw draw)
+    {
+        keys.push_back(makeKey(pass, depth, draw));
+        draws.push_back(std::move(draw));
+    }
+
+    // 'callback' runs after the draws of 'pass', even if the pass has no draws
+    void setPassEndCallback(Pass pass, std::function<void()> callback)
+    {
+        passEndCallbacks[pass] = std::move(callback);
+    }
+
+    // turn the depth pre-pass on or off, 'program' and 'instancedProgram' write depth only
+    // and take the model matrix of non-instanced draws in a 'model' uniform
+    void setDepthPrepass(bool enabled, unsigned int program = 0, unsigned int instancedProgram = 0)
+    {
+        if (enabled != depthPrepass && opaqueTimer)
+        {
+            opaqueTimer->reset();
+            depthPrepassTimer->reset();
+        }
+        depthPrepass = enabled;
+        if (program != 0)
+        {
+            depthProgram = program;
+            depthModelLocation = glGetUniformLocation(program, "model");
+        }
+        if (instancedProgram != 0)
+            depthInstancedProgram = instancedProgram;
+    }
+
+    bool isDepthPrepassOn() const { return depthPrepass; }
+
+    // time the passes of execute() with 'profiler' (nullptr to stop)
+    void setGpuProfiler(GpuProfiler* profiler)
+    {
+        gpuProfiler = profiler;
+    }
+
+    // cull the draws of the next execute() against 'frustum' (usually extracted from projection * view)
+    void setFrustum(const Frustum &frustum)
+    {
+        cullingFrustum = frustum;
+        hasFrustum = true;
+    }
+
+    // true if the next execute() will drop 'draw' because its bounding sphere is outside of the frustum
+    bool isCulled(const Draw &draw) const
+    {
+        return hasFrustum && draw.bounds[3] >= 0.0f &&
+               !cullingFrustum.intersectsSphere(glm::vec3(draw.bounds[0], draw.bounds[1], draw.bounds[2]), draw.bounds[3]);
+    }
+
+    // sort and issue every submitted draw, then clear the queue
+    void execute()
+    {
+        PROFILE_SCOPE("RenderQueue::execute");
+        stats = Stats();
+        stats.submitted = (unsigned int) draws.size();
+
+        cull();
+        sort();
+        stats.draws = (unsigned int) order.size();
+
+        GLboolean blendWasEnabled = glIsEnabled(GL_BLEND);
+        // nothing is assumed about the state left by the code that ran before the queue,
+        // it may have bound objects without going through GLState
+        GLState::invalidate();
+
+        if (!opaqueTimer)
+        {
+            opaqueTimer.reset(new GpuTimer());
+            depthPrepassTimer.reset(new GpuTimer());
+        }
+
+        // draws of the same pass are next to each other once sorted
+        unsigned int i = 0;
+        for (unsigned int pass = OPAQUE_PASS; pass <= BLENDED_PASS; pass++)
+        {
+            if (pass == BLENDED_PASS)
+                glEnable(GL_BLEND);
+            else
+                glDisable(GL_BLEND);
+
+            unsigned int passBegin = i;
+            while (i < order.size() && (keys[order[i]] >> 62) == pass)
+                i++;
+
+            if (pass == OPAQUE_PASS)
+                executeOpaque(passBegin, i);
+            else
+            {
+                GpuProfiler::Scope gpuScope(gpuProfiler, "blended pass");
+                for (unsigned int j = passBegin; j < i; j++)
+                    issue(draws[order[j]]);
+            }
+
+            if (passEndCallbacks[pass])
+            {
+                passEndCallbacks[pass]();
+                // the callback is free to change the bound state
+                GLState::invalidate();
+            }
+        }
+
+        // leave the state as the rest of the code expects it
+        GLState::bindVertexArray(0);
+        GLState::activeTexture(GL_TEXTURE0);
+        if (blendWasEnabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+
+        keys.clear();
+        draws.clear();
+        hasFrustum = false;
+
+        stats.opaqueMs = opaqueTimer->averageMs;
+        stats.depthPrepassMs = depthPrepass ? depthPrepassTimer->averageMs : 0.0f;
+    }
+
+    const Stats& lastStats() const { return stats; }
+
+private:
+    std::vector<std::uint64_t> keys;
+    std::vector<Draw> draws;
+    std::vector<std::uint32_t> order, orderTemp;
+    std::vector<std::uint64_t> sortedKeys, sortedKeysTemp;
+    Stats stats;
+
+    std::function<void()> passEndCallbacks[2];
+    bool depthPrepass = false;
+    unsigned int depthProgram = 0, depthInstancedProgram = 0;
+    int depthModelLocation = -1;
+    std::unique_ptr<GpuTimer> opaqueTimer, depthPrepassTimer;
+    GpuProfiler* gpuProfiler = nullptr;
+
+    Frustum cullingFrustum;
+    bool hasFrustum = false;
+    std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+    std::vector<unsigned char> visible;
+
+    // issue the opaque draws order[begin] to order[end-1], with the depth pre-pass if it is on
+    void executeOpaque(unsigned int begin, unsigned int end)
+    {
+        PROFILE_SCOPE("RenderQueue::executeOpaque");
+        GpuProfiler::Scope gpuScope(gpuProfiler, "opaque pass");
+        if (!depthPrepass)
+        {
+            opaqueTimer->begin();
+            for (unsigned int i = begin; i < end; i++)
+                issue(draws[order[i]]);
+            opaqueTimer->end();
+            return;
+        }
+
+        GLboolean colorWrites[4], depthWrites;
+        glGetBooleanv(GL_COLOR_WRITEMASK, colorWrites);
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &depthWrites);
+        GLint depthFunc;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+
+        depthPrepassTimer->begin();
+        if (gpuProfiler)
+            gpuProfiler->beginPass("depth pre-pass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (unsigned int i = begin; i < end; i++)
+            issueDepth(draws[order[i]]);
+        glColorMask(colorWrites[0], colorWrites[1], colorWrites[2], colorWrites[3]);
+        if (gpuProfiler)
+            gpuProfiler->endPass();
+        depthPrepassTimer->end();
+
+        // only the closest fragment of each pixel passes, and the depth buffer is already complete
+        opaqueTimer->begin();
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        for (unsigned int i = begin; i < end; i++)
+            issue(draws[order[i]]);
+        glDepthFunc(depthFunc);
+        glDepthMask(depthWrites);
+        opaqueTimer->end();
+    }
+
+    // draw 'draw' with the depth-only programs
+    void issueDepth(const Draw &draw)
+    {
+        bindProgram(draw.instanceCount > 0 ? depthInstancedProgram : depthProgram);
+        bindVertexArray(draw.VAO);
+        if (draw.instanceCount == 0)
+            glUniformMatrix4fv(depthModelLocation, 1, GL_FALSE, &draw.model[0][0]);
+        drawCall(draw);
+    }
+
+    void bindProgram(unsigned int program)
+    {
+        if (GLState::useProgram(program))
+            stats.programBinds++;
+        else
+            stats.savedBinds++;
+    }
+
+    void bindVertexArray(unsigned int VAO)
+    {
+        if (GLState::bindVertexArray(VAO))
+            stats.vaoBinds++;
+        else
+            stats.savedBinds++;
+    }
+
+    // bind the state of 'draw' that is not current already, and draw
+    void issue(const Draw &draw)
+    {
+        bindProgram(draw.program);
+        bindVertexArray(draw.VAO);
+
+        for (unsigned int unit = 0; unit < draw.textureCount; unit++)
+        {
+            if (GLState::bindTextureUnit(unit, GL_TEXTURE_2D, draw.textures[unit]))
+                stats.textureBinds++;
+            else
+                stats.savedBinds++;
+        }
+
+        if (draw.setUniforms)
+            draw.setUniforms();
+
+        drawCall(draw);
+    }
+
+    void drawCall(const Draw &draw)
+    {
+        if (draw.conditionQuery)
+            glBeginConditionalRender(draw.conditionQuery, GL_QUERY_NO_WAIT);
+
+        if (draw.indexed)
+        {
+            const void* offset = (const void*) (draw.first * sizeof(unsigned int));
+            if (draw.instanceCount > 0)
+                glDrawElementsInstanced(draw.mode, draw.count, GL_UNSIGNED_INT, offset, draw.instanceCount);
+            else
+                glDrawElements(draw.mode, draw.count, GL_UNSIGNED_INT, offset);
+        }
+        else if (!draw.firsts.empty())
+            glMultiDrawArrays(draw.mode, draw.firsts.data(), draw.counts.data(), (GLsizei) draw.firsts.size());
+        else
+        {
+            if (draw.instanceCount > 0)
+                glDrawArraysInstanced(draw.mode, draw.first, draw.count, draw.instanceCount);
+            else
+                glDrawArrays(draw.mode, draw.first, draw.count);
+        }
+
+        if (draw.conditionQuery)
+            glEndConditionalRender();
+    }
+
+    // 30 bits that increase with the depth: the bits of a non negative float are ordered like the float itself
+    static std::uint64_t quantizeDepth(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        std::uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 1;
+    }
+
+    static std::uint64_t makeKey(Pass pass, float depth, const Draw &draw)
+    {
+        std::uint64_t program = draw.program & 0xFFu;
+        std::uint64_t material = draw.material & 0xFFFu;
+        std::uint64_t vao = draw.VAO & 0xFFFu;
+        std::uint64_t state = (program << 24) | (material << 12) | vao;
+        std::uint64_t z = quantizeDepth(depth);
+
+        if (pass == BLENDED_PASS)
+            return ((std::uint64_t) pass << 62) | (((~z) & 0x3FFFFFFFu) << 32) | state;
+        return ((std::uint64_t) pass << 62) | (state << 30) | z;
+    }
+
+    // fills 'order' with the indices of the draws that are not culled
+    void cull()
+    {
+        PROFILE_SCOPE("RenderQueue::cull");
+        unsigned int n = (unsigned int) draws.size();
+        order.clear();
+        if (!hasFrustum)
+        {
+            for (unsigned int i = 0; i < n; i++)
+                order.push_back(i);
+            return;
+        }
+
+        // structure of arrays, padded to a multiple of 4 for cullSpheres
+        unsigned int padded = (n + 3u) & ~3u;
+        sphereX.assign(padded, 0.0f);
+        sphereY.assign(padded, 0.0f);
+        sphereZ.assign(padded, 0.0f);
+        sphereRadius.assign(padded, 0.0f);
+        visible.resize(padded);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            sphereX[i] = draws[i].bounds[0];
+            sphereY[i] = draws[i].bounds[1];
+            sphereZ[i] = draws[i].bounds[2];
+            sphereRadius[i] = draws[i].bounds[3];
+        }
+        cullSpheres(cullingFrustum, sphereX.data(), sphereY.data(), sphereZ.data(), sphereRadius.data(), n, visible.data());
+
+        for (unsigned int i = 0; i < n; i++)
+        {
+            if (visible[i] || draws[i].bounds[3] < 0.0f)
+                order.push_back(i);
+            else
+                stats.culled++;
+        }
+    }
+
+    // LSD radix sort of the draw indices in 'order' by key, 8 bits per pass; passes over a byte that is the same in
+    // every key are skipped, which is common since most frames only use a few programs and VAOs
+    void sort()
+    {
+        PROFILE_SCOPE("RenderQueue::sort");
+        unsigned int n = (unsigned int) order.size();
+        orderTemp.resize(n);
+        sortedKeys.resize(n);
+        sortedKeysTemp.resize(n);
+        for (unsigned int i = 0; i < n; i++)
+            sortedKeys[i] = keys[order[i]];
+
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int histogram[256] = {0};
+            for (unsigned int i = 0; i < n; i++)
+                histogram[(sortedKeys[i] >> shift) & 0xFF]++;
+            if (n == 0 || histogram[(sortedKeys[0] >> shift) & 0xFF] == n)
+                continue;
+
+            unsigned int offset = 0;
+            for (unsigned int b = 0; b < 256; b++)
+            {
+                unsigned int count = histogram[b];
+                histogram[b] = offset;
+                offset += count;
+            }
+            for (unsigned int i = 0; i < n; i++)
+            {
+                unsigned int dst = histogram[(sortedKeys[i] >> shift) & 0xFF]++;
+                sortedKeysTemp[dst] = sortedKeys[i];
+                orderTemp[dst] = order[i];
+            }
+            sortedKeys.swap(sortedKeysTemp);
+            order.swap(orderTemp);
+        }
+    }
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RENDER_QUEUE_H
@@ -0,0 +1,191 @@
+//
+// GLSL preprocessing: #include resolution, #define injection and lazily compiled shader permutations.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SHADER_PREPROCESSOR_H
+#define ITU_GRAPHICS_PROGRAMMING_SHADER_PREPROCESSOR_H
+
+#include <program_cache.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Set of '#define NAME VALUE' that specializes a shader. The defines are kept sorted by name, so the same set
+// always gives the same text and the same hash, no matter in which order it was built.
+class ShaderDefines
+{
+public:
+    ShaderDefines& set(const std::string &name, const std::string &value = "")
+    {
+        defines[name] = value;
+        return *this;
+    }
+
+    ShaderDefines& set(const std::string &name, int value)
+    {
+        return set(name, std::to_string(value));
+    }
+
+    ShaderDefines& unset(const std::string &name)
+    {
+        defines.erase(name);
+        return *this;
+    }
+
+    bool isSet(const std::string &name) const { return defines.count(name) != 0; }
+
+    // the '#define' lines, one per define
+    std::string toString() const
+    {
+        std::string text;
+        for (const auto &define : defines)
+            text += "#define " + define.first + (define.second.empty() ? "" : " " + define.second) + "\n";
+        return text;
+    }
+
+    std::uint64_t hash() const { return ProgramCache::hash(toString()); }
+
+private:
+    std::map<std::string, std::string> defines;
+};
+
+
+// Builds the source of a shader stage from a file:
+//  - lines '#include "file"' are replaced by the content of 'file' (relative to the including file), recursively;
+//    a file is only included once per stage, so shared declarations (e.g. uniform blocks) need no include guards;
+//  - the defines are inserted right after the '#version' line, so that the shader can test them with #ifdef/#if.
+// '#line' directives keep the line numbers of the compile errors right, errors are reported as
+// 'file(line)' where file 0 is the stage itself and the included files are numbered in order of inclusion.
+namespace ShaderPreprocessor {
+
+    inline std::string directoryOf(const std::string &path){
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+
+    inline bool readFile(const std::string &path, std::string &content){
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        content = stream.str();
+        return true;
+    }
+
+    // appends 'source' to 'output', with its includes resolved, 'included' lists the files already in 'output'
+    inline void resolveIncludes(const std::string &source, const std::string &directory, int fileNumber,
+                                std::vector<std::string> &included, std::string &output){
+        std::istringstream lines(source);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(lines, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                output += line + "\n";
+                continue;
+            }
+
+            size_t open = line.find('"', start), close = line.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos) {
+                std::cout << "ERROR::SHADER_PREPROCESSOR::MALFORMED_INCLUDE " << line << std::endl;
+                output += "\n";
+                continue;
+            }
+            std::string path = directory + line.substr(open + 1, close - open - 1);
+            if (std::find(included.begin(), included.end(), path) != included.end()) {
+                output += "\n";
+                continue;
+            }
+
+            std::string content;
+            if (!readFile(path, content)) {
+                std::cout << "ERROR::SHADER_PREPROCESSOR::INCLUDE_NOT_FOUND " << path << std::endl;
+                output += "\n";
+                continue;
+            }
+            included.push_back(path);
+            int includedNumber = (int) included.size();
+            output += "#line 1 " + std::to_string(includedNumber) + "\n";
+            resolveIncludes(content, directoryOf(path), includedNumber, included, output);
+            // back to the line after the #include
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileNumber) + "\n";
+        }
+    }
+
+    // 'source' with its includes resolved (relative to 'directory') and specialized with 'defines'
+    inline std::string process(const std::string &source, const std::string &directory, const ShaderDefines &defines = ShaderDefines()){
+        std::string resolved;
+        std::vector<std::string> included;
+        resolveIncludes(source, directory, 0, included, resolved);
+
+        // the defines go after #version, which must be the first statement of the shader
+        std::string injected = defines.toString();
+        size_t version = resolved.find("#version");
+        if (version == std::string::npos)
+            return injected + "#line 1 0\n" + resolved;
+        size_t lineEnd = resolved.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return resolved + "\n" + injected;
+        int versionLine = 1 + (int) std::count(resolved.begin(), resolved.begin() + lineEnd, '\n');
+        return resolved.substr(0, lineEnd + 1) + injected +
+               "#line " + std::to_string(versionLine + 1) + " 0\n" + resolved.substr(lineEnd + 1);
+    }
+
+    // reads 'path' and processes it, returns an empty string if the file can't be read
+    inline std::string load(const std::string &path, const ShaderDefines &defines = ShaderDefines()){
+        std::string source;
+        if (!readFile(path, source)) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return "";
+        }
+        return process(source, directoryOf(path), defines);
+    }
+}
+
+
+// The permutations of one shader program, compiled the first time they are requested and kept by the hash of
+// their define set. ShaderT is the Shader class of the exercise, constructed from the stage paths and the defines.
+// 'onCreate' is called on every new permutation, e.g. to map its uniform blocks to their binding points.
+template <class ShaderT>
+class ShaderVariants
+{
+public:
+    std::function<void(ShaderT&)> onCreate;
+
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, const std::string &geometryPath = "")
+            : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath)
+    {
+    }
+
+    ShaderT& get(const ShaderDefines &defines)
+    {
+        std::unique_ptr<ShaderT> &variant = variants[defines.hash()];
+        if (!variant) {
+            variant.reset(new ShaderT(vertexPath.c_str(), fragmentPath.c_str(),
+                                      geometryPath.empty() ? nullptr : geometryPath.c_str(), defines));
+            if (onCreate)
+                onCreate(*variant);
+        }
+        return *variant;
+    }
+
+    // number of permutations compiled so far
+    size_t size() const { return variants.size(); }
+
+private:
+    std::string vertexPath, fragmentPath, geometryPath;
+    std::unordered_map<std::uint64_t, std::unique_ptr<ShaderT>> variants;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SHADER_PREPROCESSOR_H
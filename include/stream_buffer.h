@@ -0,0 +1,155 @@
+//
+// Ring of per-frame buffer regions for streaming data that changes every frame.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_STREAM_BUFFER_H
+#define ITU_GRAPHICS_PROGRAMMING_STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+
+// One buffer split in REGION_COUNT regions of 'regionSize' bytes. Each frame writes to the next region, while
+// the GPU may still be reading the regions of the previous frames. A fence is inserted when the frame moves
+// away from a region, and waited for before the region is written again, so a region is never overwritten
+// while in use and the driver never has to synchronize or reallocate behind our back.
+// With OpenGL 4.4 the buffer is mapped once, persistent and coherent, and an upload is a memcpy. Older contexts
+// map each allocation with glMapBufferRange(GL_MAP_UNSYNCHRONIZED_BIT) instead, which is safe thanks to the fences.
+// The allocations are bound by offset (e.g. glBindBufferRange, or the offset of glVertexAttribPointer).
+class StreamBuffer
+{
+public:
+    static const unsigned int REGION_COUNT = 3;
+
+    struct Allocation {
+        void* pointer = nullptr;  // where to write the data, nullptr if the region is full
+        GLintptr offset = 0;      // offset of the data in the buffer
+        GLsizeiptr size = 0;
+    };
+
+    unsigned int ID = 0;
+    // number of frames in which the CPU had to wait for the GPU to release a region
+    unsigned int waits = 0;
+
+    explicit StreamBuffer(GLsizeiptr regionSize) : regionSize(regionSize)
+    {
+        persistent = GLAD_GL_VERSION_4_4 != 0;
+        glGenBuffers(1, &ID);
+        // GL_COPY_WRITE_BUFFER is not used by the drawing code, binding it does not disturb other bindings
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, nullptr, flags);
+            mapped = (char*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * REGION_COUNT, flags);
+        }
+        else
+            glBufferData(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    ~StreamBuffer()
+    {
+        for (GLsync &fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (persistent)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &ID);
+    }
+
+    // move to the region of a new frame, call it once per frame before the allocations of the frame
+    void beginFrame()
+    {
+        // the commands that read the region of the last frame have all been issued by now
+        if (started)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        started = true;
+
+        region = (region + 1) % REGION_COUNT;
+        head = 0;
+        if (fences[region])
+        {
+            GLenum status = glClientWaitSync(fences[region], 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                waits++;
+                // flush, otherwise the fence may never be submitted to the GPU
+                while (status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+    }
+
+    // reserve 'size' bytes in the region of the frame, with the offset aligned to 'alignment' (a power of two),
+    // write the data to 'pointer' and call commit() before the GPU reads it or before the next allocation
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16)
+    {
+        Allocation allocation;
+        GLsizeiptr start = (head + alignment - 1) & ~(alignment - 1);
+        if (!started || start + size > regionSize)
+        {
+            std::cout << "ERROR::STREAM_BUFFER::REGION_FULL " << size << " bytes requested, "
+                      << regionSize - head << " left" << std::endl;
+            return allocation;
+        }
+        head = start + size;
+        allocation.offset = region * regionSize + start;
+        allocation.size = size;
+        if (persistent)
+            allocation.pointer = mapped + allocation.offset;
+        else
+        {
+            // the fences guarantee that the GPU is done with the range, the driver doesn't need to check
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            allocation.pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.offset, size,
+                                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        }
+        return allocation;
+    }
+
+    // make the data written to 'allocation' visible to the GPU (nothing to do when the buffer is coherent)
+    void commit(const Allocation &allocation)
+    {
+        if (persistent || !allocation.pointer)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // copy 'size' bytes of 'data' to a new allocation, returns its offset or -1 if the region is full
+    GLintptr upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16)
+    {
+        Allocation allocation = allocate(size, alignment);
+        if (!allocation.pointer)
+            return -1;
+        std::memcpy(allocation.pointer, data, size);
+        commit(allocation);
+        return allocation.offset;
+    }
+
+    GLsizeiptr getRegionSize() const { return regionSize; }
+    bool isPersistent() const { return persistent; }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+private:
+    GLsizeiptr regionSize;
+    bool persistent = false;
+    char* mapped = nullptr;
+    GLsync fences[REGION_COUNT] = {0, 0, 0};
+    unsigned int region = REGION_COUNT - 1;
+    GLsizeiptr head = 0;
+    bool started = false;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_STREAM_BUFFER_H
@@ -0,0 +1,56 @@
+//
+// Streams CPU images to a texture through pixel buffer objects, without stalling on the copy.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_TEXTURE_UPLOADER_H
+#define ITU_GRAPHICS_PROGRAMMING_TEXTURE_UPLOADER_H
+
+#include <glad/glad.h>
+
+#include <stream_buffer.h>
+#include <gl_state.h>
+
+// Uploads a full RGBA8 image to a 2D texture every frame. The texture storage is allocated once, and each image
+// is copied to a region of a StreamBuffer bound as GL_PIXEL_UNPACK_BUFFER. glTexSubImage2D then reads from the
+// buffer, so it only queues the transfer and returns: the GPU copies the image of frame N-1 while the CPU renders
+// frame N. glTexImage2D from client memory would instead reallocate the texture and copy synchronously.
+// The texture parameters (filtering, wrapping) are left to the caller.
+class TextureUploader
+{
+public:
+    // allocates the storage of 'texture' (width x height, GL_RGBA8)
+    TextureUploader(unsigned int texture, int width, int height)
+            : texture(texture), width(width), height(height), stream((GLsizeiptr) width * height * 4)
+    {
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, texture);
+        if (GLAD_GL_VERSION_4_2)
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    // copies 'pixels' (width x height colors, 8 bits per channel in RGBA order) to the texture
+    void upload(const void* pixels)
+    {
+        stream.beginFrame();
+        GLintptr offset = stream.upload(pixels, (GLsizeiptr) width * height * 4, 4);
+        if (offset < 0)
+            return;
+
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.ID);
+        // with an unpack buffer bound, the last argument is an offset in the buffer
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*) offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // number of uploads that had to wait for the GPU to finish a previous transfer
+    unsigned int getWaits() const { return stream.waits; }
+
+private:
+    unsigned int texture;
+    int width, height;
+    StreamBuffer stream;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_TEXTURE_UPLOADER_H
@@ -0,0 +1,61 @@
+//
+// Uniform buffer object holding a std140 uniform block.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_UNIFORM_BUFFER_H
+#define ITU_GRAPHICS_PROGRAMMING_UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <stream_buffer.h>
+
+#include <memory>
+
+// A buffer bound to a fixed GL_UNIFORM_BUFFER binding point. Programs read it through a
+// 'layout (std140) uniform' block mapped to the same binding point (see Shader::setUniformBlockBinding),
+// so a single update is visible to every program that declares the block.
+// The C++ struct that is uploaded must follow the std140 layout rules (e.g. use vec4 instead of vec3).
+// Every update is written to a new region of a StreamBuffer and bound with glBindBufferRange, so an update never
+// waits for the draws that still read the previous content.
+class UniformBuffer
+{
+public:
+    unsigned int ID = 0;
+    unsigned int binding;
+    GLsizeiptr size;
+
+    UniformBuffer(GLsizeiptr size, unsigned int binding) : binding(binding), size(size)
+    {
+        // the offsets given to glBindBufferRange must be multiples of the alignment
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        this->alignment = alignment;
+        stream.reset(new StreamBuffer((size + alignment - 1) / alignment * alignment));
+        ID = stream->ID;
+    }
+
+    // replace the whole content of the buffer
+    void update(const void* data)
+    {
+        stream->beginFrame();
+        GLintptr offset = stream->upload(data, size, alignment);
+        if (offset >= 0)
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, offset, size);
+    }
+
+    template <class T>
+    void update(const T &data)
+    {
+        static_assert(sizeof(T) % 16 == 0, "std140 blocks are padded to a multiple of 16 bytes");
+        update((const void*) &data);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+private:
+    GLsizeiptr alignment;
+    std::unique_ptr<StreamBuffer> stream;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_UNIFORM_BUFFER_H